@@ -0,0 +1,99 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+/*
+ * Kernel build configuration.
+ *
+ * Every option can be overridden from the command line, e.g.
+ *   make CONFIG="-DCONFIG_PREEMPTION=1"
+ */
+
+/* Preempt tasks when their time slice runs out (0 = cooperative only) */
+#ifndef CONFIG_PREEMPTION
+#define CONFIG_PREEMPTION       0
+#endif
+
+/* CPU cores to schedule on (1 = PRO CPU only, the APP CPU stays parked) */
+#ifndef CONFIG_NUM_CORES
+#define CONFIG_NUM_CORES        2
+#endif
+
+/* System tick frequency */
+#ifndef CONFIG_TICK_HZ
+#define CONFIG_TICK_HZ          1000
+#endif
+
+/* Default time slice for new tasks, in ticks */
+#ifndef CONFIG_TIME_SLICE_TICKS
+#define CONFIG_TIME_SLICE_TICKS 10
+#endif
+
+/* Stop the periodic tick while idle and sleep until the next deadline */
+#ifndef CONFIG_TICKLESS_IDLE
+#define CONFIG_TICKLESS_IDLE    1
+#endif
+
+/* Most verbose log level compiled in (1 = error ... 4 = debug, 0 = none) */
+#ifndef CONFIG_LOG_LEVEL
+#define CONFIG_LOG_LEVEL        3
+#endif
+
+/*
+ * Queue log messages as binary tokens for the log task to send, decoded
+ * on the host by tools/log_decode (0 = print immediately as text)
+ */
+#ifndef CONFIG_LOG_DEFERRED
+#define CONFIG_LOG_DEFERRED     1
+#endif
+
+/* Count contention and hold times of spinlocks and mutexes */
+#ifndef CONFIG_LOCK_STATS
+#define CONFIG_LOCK_STATS       1
+#endif
+
+/* Count dispatches and handler cycles per interrupt */
+#ifndef CONFIG_IRQ_STATS
+#define CONFIG_IRQ_STATS        1
+#endif
+
+/* Per-task CPU time, switch counts and scheduler latency histograms */
+#ifndef CONFIG_SCHED_STATS
+#define CONFIG_SCHED_STATS      1
+#endif
+
+/*
+ * Give the idle, log, demo and benchmark tasks static TCBs and stacks in
+ * .bss and skip the TCB and stack pools, so boot makes no heap
+ * allocations and the whole heap is left to the application
+ */
+#ifndef CONFIG_STATIC_TASKS
+#define CONFIG_STATIC_TASKS     0
+#endif
+
+/*
+ * Fill task stacks with a pattern to measure their high-water marks, and
+ * check the lowest word on every switch to catch overflows
+ */
+#ifndef CONFIG_STACK_CHECK
+#define CONFIG_STACK_CHECK      1
+#endif
+
+/*
+ * Mark free pool objects and reject a pool_free() of an object that is
+ * already on its pool's free list
+ */
+#ifndef CONFIG_POOL_CHECK
+#define CONFIG_POOL_CHECK       1
+#endif
+
+/* Record scheduler, interrupt and heap events for trace_dump() */
+#ifndef CONFIG_TRACE
+#define CONFIG_TRACE            0
+#endif
+
+/* Run the on-target benchmarks (src/apps/bench.c) once after boot */
+#ifndef CONFIG_BENCHMARKS
+#define CONFIG_BENCHMARKS       0
+#endif
+
+#endif /* CONFIG_H */
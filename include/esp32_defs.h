@@ -35,6 +35,24 @@
 #define UART_TXFIFO_CNT_S           16
 #define UART_RXFIFO_CNT_S           0
 
+/* Hardware FIFO depth (TX and RX) */
+#define UART_FIFO_SIZE              128
+
+/* UART interrupt bits (INT_RAW/ST/ENA/CLR) */
+#define UART_RXFIFO_FULL_INT        BIT(0)
+#define UART_TXFIFO_EMPTY_INT       BIT(1)
+#define UART_RXFIFO_OVF_INT         BIT(4)
+#define UART_RXFIFO_TOUT_INT        BIT(8)
+
+/* UART CONF1 fields */
+#define UART_RXFIFO_FULL_THRHD_S    0       /* RXFIFO_FULL when more than this many bytes */
+#define UART_RXFIFO_FULL_THRHD      0x7F
+#define UART_TXFIFO_EMPTY_THRHD_S   8       /* TXFIFO_EMPTY when fewer than this many bytes */
+#define UART_TXFIFO_EMPTY_THRHD     0x7F
+#define UART_RX_TOUT_THRHD_S        24      /* RX timeout, in byte times */
+#define UART_RX_TOUT_THRHD          0x7F
+#define UART_RX_TOUT_EN             BIT(31)
+
 /* UART Config bits */
 #define UART_TICK_REF_ALWAYS_ON     BIT(27)
 #define UART_PARITY_EN              BIT(1)
@@ -80,28 +98,65 @@
 /* ===== DPORT Registers (System/Clock) ===== */
 #define DPORT_APPCPU_CTRL_A_REG     (DR_REG_DPORT_BASE + 0x02C)
 #define DPORT_APPCPU_CTRL_B_REG     (DR_REG_DPORT_BASE + 0x030)
+#define DPORT_APPCPU_CTRL_C_REG     (DR_REG_DPORT_BASE + 0x034)
 #define DPORT_CPU_PER_CONF_REG      (DR_REG_DPORT_BASE + 0x03C)
 #define DPORT_PRO_CACHE_CTRL_REG    (DR_REG_DPORT_BASE + 0x040)
 #define DPORT_PRO_CACHE_CTRL1_REG   (DR_REG_DPORT_BASE + 0x044)
+#define DPORT_APP_CACHE_CTRL_REG    (DR_REG_DPORT_BASE + 0x058)
+#define DPORT_APP_CACHE_CTRL1_REG   (DR_REG_DPORT_BASE + 0x05C)
+
+/* APP CPU control bits */
+#define DPORT_APPCPU_RESETTING      0       /* CTRL_A: hold the APP CPU in reset */
+#define DPORT_APPCPU_CLKGATE_EN     0       /* CTRL_B: clock the APP CPU */
+#define DPORT_APPCPU_RUNSTALL       0       /* CTRL_C: stall the APP CPU */
+
+/* Cache control bits (PRO and APP) */
+#define DPORT_CACHE_ENABLE          3
+
+/* Flash MMU tables, one 64KB page per entry */
+#define DPORT_PRO_FLASH_MMU_TABLE   0x3FF10000
+#define DPORT_APP_FLASH_MMU_TABLE   0x3FF12000
+#define DPORT_FLASH_MMU_ENTRIES     256
 
 /* ===== Interrupt Registers ===== */
-#define DPORT_PRO_INTR_STATUS_0_REG     (DR_REG_DPORT_BASE + 0x0DC)
-#define DPORT_PRO_INTR_STATUS_1_REG     (DR_REG_DPORT_BASE + 0x0E0)
-#define DPORT_PRO_INTR_STATUS_2_REG     (DR_REG_DPORT_BASE + 0x0E4)
+#define DPORT_PRO_INTR_STATUS_0_REG     (DR_REG_DPORT_BASE + 0x0EC)
+#define DPORT_PRO_INTR_STATUS_1_REG     (DR_REG_DPORT_BASE + 0x0F0)
+#define DPORT_PRO_INTR_STATUS_2_REG     (DR_REG_DPORT_BASE + 0x0F4)
+
+/* Software interrupts between cores: write 1 to raise, 0 to clear */
+#define DPORT_CPU_INTR_FROM_CPU_REG(n)  (DR_REG_DPORT_BASE + 0x0DC + (n) * 4)
+
+/* Interrupt matrix: route a peripheral source to a PRO CPU interrupt */
+#define DPORT_PRO_UART_INTR_MAP_REG     (DR_REG_DPORT_BASE + 0x18C)
+#define DPORT_PRO_CPU_INTR_FROM_CPU_0_MAP_REG   (DR_REG_DPORT_BASE + 0x164)
+
+/* Interrupt matrix: route a peripheral source to an APP CPU interrupt */
+#define DPORT_APP_CPU_INTR_FROM_CPU_1_MAP_REG   (DR_REG_DPORT_BASE + 0x27C)
 
 /* ===== CPU Frequency ===== */
 #define APB_CLK_FREQ                80000000  /* 80 MHz */
 #define CPU_CLK_FREQ                160000000 /* 160 MHz */
 
 /* ===== Interrupt Numbers ===== */
+#define ETS_FROM_CPU_INUM           2   /* Cross-core interrupt, both cores */
 #define ETS_UART0_INUM              5
 #define ETS_GPIO_INUM               10
 #define ETS_TIMER1_INUM             16
 
+/* CPU-internal interrupt sources */
+#define XT_TIMER0_INUM              6   /* CCOMPARE0, level 1 */
+#define XT_SOFTWARE0_INUM           7   /* Raised with INTSET, level 1 */
+
+/* CPU interrupts wired to priority levels 1-3 (the levels with C handlers) */
+#define XT_LEVEL1_INT_MASK          0x000637FF
+#define XT_LEVEL2_INT_MASK          0x00380000  /* 19-21 */
+#define XT_LEVEL3_INT_MASK          0x28C08800  /* 11, 15, 22, 23, 27, 29 */
+
 /* ===== ROM Functions ===== */
 /* ESP32 ROM contains useful functions we can call */
 extern void ets_delay_us(uint32_t us);
 extern void ets_printf(const char *fmt, ...);
+extern void ets_set_appcpu_boot_addr(uint32_t addr);
 
 /* ===== External symbols from linker script ===== */
 extern uint32_t _bss_start;
@@ -109,6 +164,7 @@ extern uint32_t _bss_end;
 extern uint32_t _data_start;
 extern uint32_t _data_end;
 extern uint32_t _stack_top;
+extern uint32_t _app_stack_top;
 extern uint32_t _heap_start;
 extern uint32_t _heap_end;
 
@@ -0,0 +1,48 @@
+#ifndef EVENT_GROUP_H
+#define EVENT_GROUP_H
+
+#include "types.h"
+#include "waitq.h"
+
+/*
+ * Event groups: 32 event bits that tasks wait on.
+ *
+ * A waiter names a set of bits and waits for any or all of them to be
+ * set. event_group_set() wakes every waiter it satisfies, in the
+ * group's wait queue order, and is safe from interrupt handlers and
+ * either core.
+ */
+
+/* event_group_wait() flags */
+#define EVENT_WAIT_ANY      0x00    /* Any of the bits */
+#define EVENT_WAIT_ALL      0x01    /* All of the bits */
+#define EVENT_WAIT_CLEAR    0x02    /* Clear the waited-for bits when satisfied */
+
+typedef struct event_group {
+    const char *name;               /* Event group name for debugging */
+    uint32_t bits;                  /* Currently set events */
+    waitq_t waiters;                /* Tasks blocked in event_group_wait */
+} event_group_t;
+
+/* Initialize an event group with no bits set */
+void event_group_init(event_group_t *group, const char *name, waitq_order_t order);
+
+/* Set bits and wake the waiters now satisfied, returns the bits left set */
+uint32_t event_group_set(event_group_t *group, uint32_t bits);
+
+/* Clear bits, returns the bits set before */
+uint32_t event_group_clear(event_group_t *group, uint32_t bits);
+
+/* Currently set bits */
+uint32_t event_group_get(const event_group_t *group);
+
+/*
+ * Wait up to timeout_ms for any (EVENT_WAIT_ANY) or all (EVENT_WAIT_ALL)
+ * of bits. Returns the group's bits at the moment the wait was satisfied,
+ * before any EVENT_WAIT_CLEAR, or 0 on timeout. Interrupt handlers may
+ * only call it with a timeout of 0.
+ */
+uint32_t event_group_wait(event_group_t *group, uint32_t bits, uint32_t flags,
+                          uint32_t timeout_ms);
+
+#endif /* EVENT_GROUP_H */
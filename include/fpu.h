@@ -0,0 +1,43 @@
+#ifndef FPU_H
+#define FPU_H
+
+#include "types.h"
+#include "task.h"
+
+/*
+ * Lazy FPU context switching.
+ *
+ * Every task switch disables the FPU through CPENABLE. The first FPU
+ * instruction a task then executes raises a coprocessor exception, whose
+ * handler saves the registers of the task that last used this core's FPU
+ * into its TCB and loads the current task's. Tasks that never touch the
+ * FPU never pay for it.
+ *
+ * A task pinned to a core leaves its registers in that core's FPU until
+ * another task needs it. A task that may run on either core has its
+ * registers saved as it is switched out, so it can resume anywhere.
+ *
+ * Interrupt handlers must not use floating point.
+ */
+
+/* Coprocessor exception handler (start.S), enables the FPU for the current task */
+void fpu_exception(void);
+
+/*
+ * Called as a task is switched out, with scheduler_lock held: saves its
+ * registers if they can't stay in this core's FPU.
+ */
+void fpu_switch_out(task_t *task);
+
+/*
+ * Called before a task's affinity changes to core, with scheduler_lock
+ * held. Returns false if its registers are loaded in another core's FPU,
+ * where they can't be saved from here.
+ */
+bool fpu_prepare_move(task_t *task, int32_t core);
+
+/* Save and load FPU registers (context.S, the FPU must be enabled) */
+void fpu_save(uint32_t *state);
+void fpu_restore(const uint32_t *state);
+
+#endif /* FPU_H */
@@ -6,6 +6,9 @@
 /* Initialize heap allocator */
 void heap_init(void);
 
+/* Initialize heap allocator over an explicit memory region */
+void heap_init_region(void *start, size_t size);
+
 /* Allocate memory from heap */
 void *kmalloc(size_t size);
 
@@ -3,17 +3,40 @@
 
 #include "types.h"
 
+/*
+ * Interrupts at levels 1-3 run registered C handlers. Level-1 handlers
+ * run with level 1 masked, so a level-2 or level-3 interrupt can nest on
+ * top of them; level-2 and level-3 handlers mask their own level and
+ * below. Kernel locks are only held with levels 1-3 masked, so handlers
+ * at any level may call what is documented as safe from interrupt
+ * handlers. Only level-1 exits switch tasks: a task woken by a level-2 or
+ * level-3 handler runs at the next level-1 interrupt exit or task switch.
+ * Handlers at every level run on the interrupted task's stack.
+ */
+
 /* Interrupt handler function type */
 typedef void (*interrupt_handler_t)(void *arg);
 
+/* Dispatch statistics of one interrupt (CONFIG_IRQ_STATS) */
+typedef struct {
+    uint32_t count;                 /* Handler runs */
+    uint32_t cycles_max;            /* Longest handler run, in CCOUNT cycles */
+    uint64_t cycles_total;          /* Sum of handler runs, in CCOUNT cycles */
+} interrupt_stats_t;
+
 /* Initialize interrupt system */
 void interrupt_init(void);
 
-/* Enable interrupts globally */
-void interrupt_enable(void);
+/*
+ * Mask interrupts on this core and return the previous PS. Sections
+ * nest: each interrupt_restore() puts back the level its matching
+ * interrupt_disable() found. Only the local core is kept out; state
+ * shared with the other core also needs a spinlock (spinlock.h).
+ */
+uint32_t interrupt_disable(void);
 
-/* Disable interrupts globally */
-void interrupt_disable(void);
+/* Restore the PS returned by interrupt_disable() */
+void interrupt_restore(uint32_t ps);
 
 /* Register an interrupt handler */
 void interrupt_register_handler(uint32_t int_num, interrupt_handler_t handler, void *arg);
@@ -21,4 +44,29 @@ void interrupt_register_handler(uint32_t int_num, interrupt_handler_t handler, v
 /* Unregister an interrupt handler */
 void interrupt_unregister_handler(uint32_t int_num);
 
+/* Enable a CPU interrupt source in INTENABLE */
+void interrupt_enable_source(uint32_t int_num);
+
+/* Disable a CPU interrupt source in INTENABLE */
+void interrupt_disable_source(uint32_t int_num);
+
+/* Dispatch a single interrupt to its handler; one without a handler is disabled */
+void interrupt_dispatch(uint32_t int_num);
+
+/*
+ * Dispatch every pending, enabled interrupt of a level (called from the
+ * level 1-3 vectors), highest interrupt number first, until none is left
+ * or a bounded number of rescans has run
+ */
+void interrupt_level_dispatch(uint32_t level);
+
+/* Report an unhandled exception from its frame and halt (called from the vectors) */
+void interrupt_exception(uint32_t *frame) __attribute__((noreturn));
+
+/* Sum an interrupt's statistics over both cores */
+void interrupt_stats(uint32_t int_num, interrupt_stats_t *stats);
+
+/* Print the statistics of every interrupt that has run */
+void interrupt_dump_stats(void);
+
 #endif /* INTERRUPT_H */
@@ -2,15 +2,70 @@
 #define KERNEL_H
 
 #include "types.h"
+#include "config.h"
 #include "task.h"
+#include "spinlock.h"
+
+/* Guards all scheduler state across both cores (scheduler.c) */
+extern spinlock_t scheduler_lock;
 
 /* Scheduler functions */
 void scheduler_init(void);
 void scheduler_start(void) __attribute__((noreturn));
+void scheduler_start_secondary(void) __attribute__((noreturn));
 void scheduler_schedule(void);
 
-/* Context switch function (implemented in assembly) */
+/* Switch away if a higher priority task is ready (scheduler_lock held, released on return) */
+void scheduler_reschedule_locked(void);
+
+/* System tick handler (called from the tick interrupt) */
+void scheduler_tick(void);
+
+/* Pick the frame to resume on interrupt exit (called from the level-1 vector, levels 1-3 masked) */
+uint32_t *scheduler_isr_switch(uint32_t *frame);
+
+/* Number of system ticks since the scheduler started */
+uint32_t scheduler_get_ticks(void);
+
+/*
+ * Monotonic clock: CCOUNT cycles (or microseconds) since the scheduler
+ * started, extended to 64 bits so it never wraps. Not for use with
+ * scheduler_lock held.
+ */
+uint64_t scheduler_get_cycles(void);
+uint64_t scheduler_get_time_us(void);
+
+/* Idle loop body: run ready tasks, otherwise halt until the next interrupt */
+void scheduler_idle(void);
+
+/* Get a core's idle residency: cycles halted, cycles since start, number of sleeps */
+void scheduler_idle_stats(uint32_t core, uint64_t *idle, uint64_t *total, uint32_t *sleeps);
+
+/*
+ * Scheduler latency histograms (CONFIG_SCHED_STATS), in CCOUNT cycles.
+ * Bucket i counts samples in [2^i, 2^(i+1)), bucket 0 also counts 0 and
+ * the last bucket everything above.
+ */
+#define SCHED_HIST_BUCKETS  24
+
+typedef struct {
+    uint32_t switch_latency[SCHED_HIST_BUCKETS];  /* Entering the scheduler to the next task running */
+    uint32_t wake_latency[SCHED_HIST_BUCKETS];    /* Woken to running */
+} sched_latency_t;
+
+/* Sum both cores' latency histograms */
+void scheduler_latency_stats(sched_latency_t *stats);
+
+/* Print the latency histograms */
+void scheduler_dump_latency(void);
+
+/*
+ * Context switch functions (implemented in assembly). context_switch is
+ * called with scheduler_lock held and releases it once it has left the
+ * old task's stack.
+ */
 extern void context_switch(uint32_t **old_sp, uint32_t *new_sp);
+extern void context_start(uint32_t *new_sp) __attribute__((noreturn));
 
 /* Delay functions */
 void delay_ms(uint32_t ms);
@@ -0,0 +1,30 @@
+#ifndef KPRINTF_H
+#define KPRINTF_H
+
+#include <stdarg.h>
+#include "types.h"
+
+/*
+ * Kernel formatting core.
+ *
+ * Supports %d %i %u %x %X %o %c %s %p %% with the '-', '0', '+', ' '
+ * and '#' flags, a field width and precision (either may be '*'), and
+ * the hh, h, l, ll and z length modifiers. Output is produced in chunks
+ * (literal runs, converted fields, padding), never a byte at a time.
+ */
+
+/* Output sink: receives each chunk of formatted text in order */
+typedef void (*kfmt_out_t)(void *ctx, const char *data, size_t len);
+
+/* Format to a sink, returns the number of characters produced */
+int kvformat(kfmt_out_t out, void *ctx, const char *fmt, va_list args);
+
+/*
+ * Format into buf, always NUL-terminated when size > 0. Returns the
+ * length the full output would have, like snprintf.
+ */
+int kvsnprintf(char *buf, size_t size, const char *fmt, va_list args);
+int ksnprintf(char *buf, size_t size, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+#endif /* KPRINTF_H */
@@ -0,0 +1,143 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include "types.h"
+#include "config.h"
+
+/*
+ * Kernel logging.
+ *
+ * LOG_ERROR/WARN/INFO/DEBUG take a printf-style format and up to eight
+ * arguments. Messages above CONFIG_LOG_LEVEL compile to nothing.
+ *
+ * With CONFIG_LOG_DEFERRED, a message costs one record in a lock-free
+ * ring: the format string's ID, a CCOUNT timestamp and the raw argument
+ * words (%s strings are copied, truncated to LOG_STRING_MAX bytes).
+ * Each argument must fit in one word: 64-bit values (%lld) are rejected
+ * at compile time, so split or convert them first.
+ * Format strings are placed in the non-loaded .log_fmt ELF section, so
+ * the ID is the string's offset there and the text never reaches flash.
+ * The low-priority log task sends the records to the UART as binary
+ * frames, which tools/log_decode expands using the ELF.
+ */
+
+/* Log levels */
+#define LOG_LEVEL_NONE   0
+#define LOG_LEVEL_ERROR  1
+#define LOG_LEVEL_WARN   2
+#define LOG_LEVEL_INFO   3
+#define LOG_LEVEL_DEBUG  4
+
+/* Log ring size in 32-bit words (power of two) */
+#define LOG_BUFFER_WORDS  1024
+
+/* Longest %s argument copied into a record */
+#define LOG_STRING_MAX    32
+
+/* Most arguments per message */
+#define LOG_MAX_ARGS      8
+
+/*
+ * Record layout in the ring and on the wire (all little-endian words):
+ *   header, format ID, CCOUNT, argument words, copied strings
+ * A %s argument's word holds the length of its copy, and the copies
+ * follow the arguments in order, each NUL-terminated and word-padded.
+ */
+#define LOG_HDR_VALID           BIT(31)     /* Record fully written */
+#define LOG_HDR_PAD             BIT(30)     /* Filler up to the end of the ring */
+#define LOG_HDR_LEVEL_S         24
+#define LOG_HDR_LEVEL           0x7
+#define LOG_HDR_NARGS_S         20
+#define LOG_HDR_NARGS           0xF
+#define LOG_HDR_STRMASK_S       12          /* Bit n set: argument n is a string */
+#define LOG_HDR_STRMASK         0xFF
+#define LOG_HDR_WORDS           0xFFF       /* Record length including header */
+
+/* Format ID of the record reporting messages lost to a full ring */
+#define LOG_FMT_DROPPED         0xFFFFFFFF
+
+/* Wire frame: LOG_FRAME_SYNC, LOG_FRAME_TAG, word count, then the record */
+#define LOG_FRAME_SYNC          0xFF
+#define LOG_FRAME_TAG           'L'
+
+/* Initialize logging and start the log task */
+void log_init(void);
+
+/* Queue one record (used by the LOG_* macros) */
+void log_write(uint32_t level, uint32_t fmt_id, const uint32_t *args,
+               uint32_t nargs, uint32_t str_mask);
+
+/* Number of messages lost because the ring was full */
+uint32_t log_dropped(void);
+
+/* ===== Argument marshalling ===== */
+
+#define LOG_CAT_(a, b)  a##b
+#define LOG_CAT(a, b)   LOG_CAT_(a, b)
+
+#define LOG_NARGS(...)  LOG_NARGS_(0, ##__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define LOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, n, ...)  n
+
+/* Apply m(arg, index) to each argument */
+#define LOG_MAP(m, ...)  LOG_CAT(LOG_MAP_, LOG_NARGS(__VA_ARGS__))(m, ##__VA_ARGS__)
+#define LOG_MAP_0(m)
+#define LOG_MAP_1(m, a)                      m(a, 0)
+#define LOG_MAP_2(m, a, b)                   LOG_MAP_1(m, a) m(b, 1)
+#define LOG_MAP_3(m, a, b, c)                LOG_MAP_2(m, a, b) m(c, 2)
+#define LOG_MAP_4(m, a, b, c, d)             LOG_MAP_3(m, a, b, c) m(d, 3)
+#define LOG_MAP_5(m, a, b, c, d, e)          LOG_MAP_4(m, a, b, c, d) m(e, 4)
+#define LOG_MAP_6(m, a, b, c, d, e, f)       LOG_MAP_5(m, a, b, c, d, e) m(f, 5)
+#define LOG_MAP_7(m, a, b, c, d, e, f, g)    LOG_MAP_6(m, a, b, c, d, e, f) m(g, 6)
+#define LOG_MAP_8(m, a, b, c, d, e, f, g, h) LOG_MAP_7(m, a, b, c, d, e, f, g) m(h, 7)
+
+#define LOG_ARG_WORD(x, i)  (uint32_t)(uintptr_t)(x),
+/* Arguments are stored as one word each ("+ 0" checks arrays as the pointer passed) */
+#define LOG_ARG_CHECK(x, i) \
+    _Static_assert(sizeof((x) + 0) <= sizeof(uintptr_t), "log arguments must fit in one word");
+#define LOG_ARG_STR(x, i)   (_Generic((x), char *: 1U, const char *: 1U, default: 0U) << (i)) |
+
+#if CONFIG_LOG_DEFERRED
+
+#define LOG_EMIT(level, fmt, ...) do {                                              \
+    static const char log_fmt_[] __attribute__((section(".log_fmt"), used)) = fmt; \
+    LOG_MAP(LOG_ARG_CHECK, ##__VA_ARGS__)                                           \
+    const uint32_t log_args_[] = { LOG_MAP(LOG_ARG_WORD, ##__VA_ARGS__) };         \
+    log_write((level), (uint32_t)(uintptr_t)log_fmt_, log_args_,                   \
+              LOG_NARGS(__VA_ARGS__), LOG_MAP(LOG_ARG_STR, ##__VA_ARGS__) 0);      \
+} while (0)
+
+#else
+
+#include "uart.h"
+
+#define LOG_EMIT(level, fmt, ...)  uart_printf(fmt, ##__VA_ARGS__)
+
+#endif /* CONFIG_LOG_DEFERRED */
+
+#define LOG_NONE_(fmt, ...)  do { } while (0)
+
+#if CONFIG_LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(fmt, ...)  LOG_EMIT(LOG_LEVEL_ERROR, fmt, ##__VA_ARGS__)
+#else
+#define LOG_ERROR(fmt, ...)  LOG_NONE_(fmt, ##__VA_ARGS__)
+#endif
+
+#if CONFIG_LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(fmt, ...)   LOG_EMIT(LOG_LEVEL_WARN, fmt, ##__VA_ARGS__)
+#else
+#define LOG_WARN(fmt, ...)   LOG_NONE_(fmt, ##__VA_ARGS__)
+#endif
+
+#if CONFIG_LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(fmt, ...)   LOG_EMIT(LOG_LEVEL_INFO, fmt, ##__VA_ARGS__)
+#else
+#define LOG_INFO(fmt, ...)   LOG_NONE_(fmt, ##__VA_ARGS__)
+#endif
+
+#if CONFIG_LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(fmt, ...)  LOG_EMIT(LOG_LEVEL_DEBUG, fmt, ##__VA_ARGS__)
+#else
+#define LOG_DEBUG(fmt, ...)  LOG_NONE_(fmt, ##__VA_ARGS__)
+#endif
+
+#endif /* LOG_H */
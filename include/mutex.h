@@ -0,0 +1,67 @@
+#ifndef MUTEX_H
+#define MUTEX_H
+
+#include "types.h"
+#include "task.h"
+#include "waitq.h"
+
+/*
+ * Sleeping mutexes with priority inheritance.
+ *
+ * A task that finds the mutex taken blocks in TASK_STATE_BLOCKED on the
+ * mutex's wait queue, highest priority first. While it waits, the owner
+ * (and whatever the owner is itself waiting for) runs at least at the
+ * waiter's priority. Unlock hands the mutex straight to the first
+ * waiter. Mutexes are for tasks only, never interrupt handlers, and
+ * are not recursive. A task that exits still holding mutexes has them
+ * unlocked for it, as if by mutex_unlock().
+ */
+
+/* Profiling counters (CONFIG_LOCK_STATS) */
+typedef struct {
+    uint32_t locks;                 /* Times taken */
+    uint32_t contended;             /* Times a locker found it held */
+    uint32_t timeouts;              /* Waits that gave up */
+    uint32_t hold_max;              /* Longest hold, in CCOUNT cycles */
+    uint64_t hold_total;            /* Sum of holds, in CCOUNT cycles */
+} mutex_stats_t;
+
+typedef struct mutex {
+    const char *name;               /* Mutex name for statistics */
+    task_t *owner;                  /* Holding task, NULL when free */
+    waitq_t waiters;                /* Tasks blocked in mutex_lock */
+    struct mutex *held_next;        /* Next mutex held by the same owner */
+    uint32_t hold_start;            /* CCOUNT when taken */
+    mutex_stats_t stats;
+    struct mutex *next;             /* Next registered mutex */
+} mutex_t;
+
+/* Initialize a mutex */
+void mutex_init(mutex_t *mutex, const char *name);
+
+/*
+ * Take a mutex, waiting up to timeout_ms (TASK_WAIT_FOREVER to wait
+ * indefinitely, 0 to not wait). Returns false on timeout.
+ */
+bool mutex_lock(mutex_t *mutex, uint32_t timeout_ms);
+
+/* Take a mutex only if it is free */
+bool mutex_trylock(mutex_t *mutex);
+
+/* Release a mutex held by the current task */
+void mutex_unlock(mutex_t *mutex);
+
+/* Copy a mutex's statistics */
+void mutex_stats(const mutex_t *mutex, mutex_stats_t *stats);
+
+/* Print statistics of every mutex */
+void mutex_dump_stats(void);
+
+/*
+ * Recompute a task's priority from its base priority and the waiters of
+ * the mutexes it holds, passing any change along the chain of owners it
+ * waits on. Call with scheduler_lock held.
+ */
+void mutex_update_priority(task_t *task);
+
+#endif /* MUTEX_H */
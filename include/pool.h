@@ -0,0 +1,48 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include "types.h"
+#include "spinlock.h"
+
+/* Object alignment and stride granularity (also the Xtensa stack alignment) */
+#define POOL_ALIGN  16
+
+/* Fixed-size object pool */
+typedef struct pool {
+    const char *name;               /* Pool name for statistics */
+    uint8_t *storage;               /* First object */
+    uint32_t obj_size;              /* Object stride in bytes */
+    uint32_t capacity;              /* Number of objects */
+    uint32_t used;                  /* Objects currently allocated */
+    uint32_t peak;                  /* High-water mark of used */
+    void *free_list;                /* Singly linked list of free objects */
+    spinlock_t lock;                /* Guards free_list and the counts */
+    struct pool *next;              /* Next registered pool */
+} pool_t;
+
+/* Initialize a pool over caller-provided storage (count * stride bytes) */
+void pool_init(pool_t *pool, const char *name, size_t obj_size, uint32_t count, void *storage);
+
+/* Create a pool whose header and storage come from one heap allocation */
+pool_t *pool_create(const char *name, size_t obj_size, uint32_t count);
+
+/* Allocate one object (NULL if the pool is exhausted) */
+void *pool_alloc(pool_t *pool);
+
+/*
+ * Return an object to its pool. Objects that aren't from the pool, and
+ * frees with nothing allocated, are rejected with a warning; so is a
+ * double free with CONFIG_POOL_CHECK.
+ */
+void pool_free(pool_t *pool, void *obj);
+
+/* Check whether ptr points into the pool's storage */
+bool pool_contains(const pool_t *pool, const void *ptr);
+
+/* Get pool statistics (in objects) */
+void pool_stats(const pool_t *pool, uint32_t *total, uint32_t *used, uint32_t *free);
+
+/* Print statistics of every pool */
+void pool_dump_stats(void);
+
+#endif /* POOL_H */
@@ -0,0 +1,92 @@
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include "types.h"
+#include "waitq.h"
+
+/*
+ * Fixed-capacity message queues.
+ *
+ * Messages are fixed-size items copied into a ring of capacity slots;
+ * capacity must be a power of two. Two variants:
+ *
+ *   spsc_queue_t  One producer and one consumer. try_send/try_recv are
+ *                 wait-free: plain loads and stores of the head and tail.
+ *   mpmc_queue_t  Any number of producers and consumers, on either core
+ *                 or in handlers. Slots are claimed with S32C1I and
+ *                 carry a sequence number saying whether they are full.
+ *
+ * try_send/try_recv never block and are safe from interrupt handlers.
+ * send/recv wait up to timeout_ms (TASK_WAIT_FOREVER to wait
+ * indefinitely) for space or a message, blocked in TASK_STATE_BLOCKED.
+ * A successful try_* only takes scheduler_lock when a task on the other
+ * side is blocked and needs waking.
+ */
+
+/* Bytes of storage an MPMC slot takes (a sequence word plus the item) */
+#define MPMC_QUEUE_SLOT_SIZE(item_size)  (4 + ALIGN_UP((item_size), 4))
+
+typedef struct {
+    uint8_t *buffer;                /* capacity * item_size bytes */
+    uint32_t item_size;             /* Bytes per message */
+    uint32_t mask;                  /* capacity - 1 */
+    volatile uint32_t head;         /* Messages received, written by the consumer */
+    volatile uint32_t tail;         /* Messages sent, written by the producer */
+    waitq_t senders;                /* Tasks waiting for space */
+    waitq_t receivers;              /* Tasks waiting for a message */
+} spsc_queue_t;
+
+typedef struct {
+    uint8_t *slots;                 /* capacity * MPMC_QUEUE_SLOT_SIZE bytes */
+    uint32_t item_size;             /* Bytes per message */
+    uint32_t slot_size;             /* Stride between slots */
+    uint32_t mask;                  /* capacity - 1 */
+    volatile uint32_t head;         /* Next position to receive, claimed with S32C1I */
+    volatile uint32_t tail;         /* Next position to send, claimed with S32C1I */
+    waitq_t senders;                /* Tasks waiting for space */
+    waitq_t receivers;              /* Tasks waiting for a message */
+} mpmc_queue_t;
+
+/* Initialize an SPSC queue over capacity * item_size bytes of storage */
+bool spsc_queue_init(spsc_queue_t *queue, uint32_t item_size, uint32_t capacity, void *storage);
+
+/* Create an SPSC queue whose header and storage come from one heap allocation */
+spsc_queue_t *spsc_queue_create(uint32_t item_size, uint32_t capacity);
+
+/* Send a message if there is space (producer only) */
+bool spsc_queue_try_send(spsc_queue_t *queue, const void *item);
+
+/* Receive a message if there is one (consumer only) */
+bool spsc_queue_try_recv(spsc_queue_t *queue, void *item);
+
+/* Send a message, waiting up to timeout_ms for space */
+bool spsc_queue_send(spsc_queue_t *queue, const void *item, uint32_t timeout_ms);
+
+/* Receive a message, waiting up to timeout_ms for one */
+bool spsc_queue_recv(spsc_queue_t *queue, void *item, uint32_t timeout_ms);
+
+/* Messages currently queued */
+uint32_t spsc_queue_count(const spsc_queue_t *queue);
+
+/* Initialize an MPMC queue over capacity * MPMC_QUEUE_SLOT_SIZE(item_size) bytes */
+bool mpmc_queue_init(mpmc_queue_t *queue, uint32_t item_size, uint32_t capacity, void *storage);
+
+/* Create an MPMC queue whose header and storage come from one heap allocation */
+mpmc_queue_t *mpmc_queue_create(uint32_t item_size, uint32_t capacity);
+
+/* Send a message if there is space */
+bool mpmc_queue_try_send(mpmc_queue_t *queue, const void *item);
+
+/* Receive a message if there is one */
+bool mpmc_queue_try_recv(mpmc_queue_t *queue, void *item);
+
+/* Send a message, waiting up to timeout_ms for space */
+bool mpmc_queue_send(mpmc_queue_t *queue, const void *item, uint32_t timeout_ms);
+
+/* Receive a message, waiting up to timeout_ms for one */
+bool mpmc_queue_recv(mpmc_queue_t *queue, void *item, uint32_t timeout_ms);
+
+/* Messages currently queued (approximate while others are sending or receiving) */
+uint32_t mpmc_queue_count(const mpmc_queue_t *queue);
+
+#endif /* QUEUE_H */
@@ -0,0 +1,38 @@
+#ifndef SEMAPHORE_H
+#define SEMAPHORE_H
+
+#include "types.h"
+#include "waitq.h"
+
+/*
+ * Counting semaphores.
+ *
+ * sem_take() blocks while the count is zero, in FIFO or priority order.
+ * sem_give() hands the unit straight to the first waiter if there is
+ * one, and is safe from interrupt handlers and either core.
+ */
+typedef struct semaphore {
+    const char *name;               /* Semaphore name for debugging */
+    uint32_t count;                 /* Units available */
+    uint32_t max_count;             /* Count sem_give() stops at */
+    waitq_t waiters;                /* Tasks blocked in sem_take */
+} semaphore_t;
+
+/* Initialize a semaphore with initial units, up to max_count */
+void sem_init(semaphore_t *sem, const char *name, uint32_t initial, uint32_t max_count,
+              waitq_order_t order);
+
+/*
+ * Take a unit, waiting up to timeout_ms (TASK_WAIT_FOREVER to wait
+ * indefinitely, 0 to not wait). Returns false on timeout. Interrupt
+ * handlers may only call it with a timeout of 0.
+ */
+bool sem_take(semaphore_t *sem, uint32_t timeout_ms);
+
+/* Give a unit back, returns false if the count is already at max_count */
+bool sem_give(semaphore_t *sem);
+
+/* Units currently available */
+uint32_t sem_count(const semaphore_t *sem);
+
+#endif /* SEMAPHORE_H */
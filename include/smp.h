@@ -0,0 +1,22 @@
+#ifndef SMP_H
+#define SMP_H
+
+#include "types.h"
+#include "config.h"
+
+/* Set up cross-core interrupts on the PRO CPU */
+void smp_init(void);
+
+/*
+ * Release the APP CPU from reset and wait for it to join the scheduler
+ * (called by scheduler_start; does nothing with CONFIG_NUM_CORES = 1)
+ */
+void smp_start_app_cpu(void);
+
+/* Interrupt another core so it reschedules or leaves idle */
+void smp_send_ipi(uint32_t core);
+
+/* Number of cores running the scheduler */
+uint32_t smp_cores_online(void);
+
+#endif /* SMP_H */
@@ -0,0 +1,115 @@
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+#include "types.h"
+#include "config.h"
+#include "xtensa.h"
+
+/*
+ * Spinlocks shared between the two cores.
+ *
+ * Interrupt masking only keeps out the local core, so any state that
+ * tasks or handlers on both cores touch is guarded by a spinlock taken
+ * with interrupts masked. The lock word is claimed with S32C1I and
+ * holds the owning core's ID + 1 while taken.
+ *
+ * spin_lock_irqsave() saves the previous PS and spin_unlock_irqrestore()
+ * puts it back, so critical sections nest and may be entered from
+ * interrupt handlers. A core must not take a lock it already holds (it
+ * reports that on the serial port and halts), so every lock is held
+ * with interrupts masked up to XCHAL_EXCM_LEVEL, even in a level-1
+ * handler: otherwise a level-2 or level-3 handler taking it would
+ * deadlock.
+ */
+
+/* Profiling counters (CONFIG_LOCK_STATS) */
+typedef struct {
+    uint32_t acquired;              /* Times taken */
+    uint32_t contended;             /* Times it was already held */
+    uint32_t spins;                 /* Polls of the lock word while contended */
+    uint32_t hold_max;              /* Longest hold, in CCOUNT cycles */
+    uint64_t hold_total;            /* Sum of timed holds, in CCOUNT cycles */
+} spinlock_stats_t;
+
+typedef struct {
+    volatile uint32_t owner;        /* 0 when free, else core ID + 1 (must stay first) */
+#if CONFIG_LOCK_STATS
+    uint32_t hold_start;            /* CCOUNT when taken */
+    spinlock_stats_t stats;
+#endif
+} spinlock_t;
+
+#define SPINLOCK_INIT  { 0 }
+
+/* Initialize a lock at runtime */
+void spin_lock_init(spinlock_t *lock);
+
+/* Wait for a lock another core holds (spinlock.c) */
+void spin_lock_contended(spinlock_t *lock, uint32_t self);
+
+/* Copy a lock's statistics */
+void spin_lock_stats(const spinlock_t *lock, spinlock_stats_t *stats);
+
+/* Print a lock's statistics */
+void spin_lock_dump_stats(const char *name, const spinlock_t *lock);
+
+#ifdef __XTENSA__
+
+/* Take a lock (interrupts must already be masked up to XCHAL_EXCM_LEVEL) */
+static inline void spin_lock(spinlock_t *lock)
+{
+    uint32_t self = xt_core_id() + 1;
+
+    if (xt_compare_set(&lock->owner, 0, self) != 0) {
+        spin_lock_contended(lock, self);
+    }
+
+#if CONFIG_LOCK_STATS
+    lock->stats.acquired++;
+    lock->hold_start = xt_get_ccount();
+#endif
+}
+
+/*
+ * Release a lock. The context switch paths in assembly release
+ * scheduler_lock with a plain store, so those holds aren't timed.
+ */
+static inline void spin_unlock(spinlock_t *lock)
+{
+#if CONFIG_LOCK_STATS
+    uint32_t held = xt_get_ccount() - lock->hold_start;
+    lock->stats.hold_total += held;
+    if (held > lock->stats.hold_max) {
+        lock->stats.hold_max = held;
+    }
+#endif
+
+    __atomic_store_n(&lock->owner, 0, __ATOMIC_RELEASE);
+}
+
+/* Mask interrupts and take a lock, returns the PS to restore */
+static inline uint32_t spin_lock_irqsave(spinlock_t *lock)
+{
+    uint32_t ps = xt_irq_save();
+    spin_lock(lock);
+    return ps;
+}
+
+/* Release a lock and restore the PS returned by spin_lock_irqsave() */
+static inline void spin_unlock_irqrestore(spinlock_t *lock, uint32_t ps)
+{
+    spin_unlock(lock);
+    xt_irq_restore(ps);
+}
+
+#else
+
+/* Host builds of kernel sources (tools/) are single-threaded */
+static inline void spin_lock(spinlock_t *lock) { (void)lock; }
+static inline void spin_unlock(spinlock_t *lock) { (void)lock; }
+static inline uint32_t spin_lock_irqsave(spinlock_t *lock) { (void)lock; return 0; }
+static inline void spin_unlock_irqrestore(spinlock_t *lock, uint32_t ps) { (void)lock; (void)ps; }
+
+#endif /* __XTENSA__ */
+
+#endif /* SPINLOCK_H */
@@ -2,6 +2,7 @@
 #define TASK_H
 
 #include "types.h"
+#include "config.h"
 
 /* Task states */
 typedef enum {
@@ -13,13 +14,70 @@ typedef enum {
 
 /* Task stack size */
 #define TASK_STACK_SIZE  2048  /* 2KB per task */
-#define MAX_TASKS        8     /* Maximum number of tasks */
+#define TASK_TCB_POOL    8     /* TCBs kept in a pool, more come from the heap */
+#define TASK_STACK_ALIGN 16    /* Alignment for stacks given to task_create_static */
+#define TASK_STACK_POOL  4     /* TASK_STACK_SIZE stacks kept in a pool */
+
+/* Word in every stack slot a task has never used (CONFIG_STACK_CHECK) */
+#define TASK_STACK_FILL  0xA5A5A5A5
+
+/* Words of FPU state kept per task: f0-f15, FCR and FSR */
+#define TASK_FPU_STATE_WORDS  18
+
+/* Task priorities (higher value runs first) */
+#define TASK_PRIORITY_LEVELS  32
+#define TASK_PRIORITY_IDLE    0
+#define TASK_PRIORITY_LOW     1
+#define TASK_PRIORITY_NORMAL  4
+#define TASK_PRIORITY_HIGH    8
+#define TASK_PRIORITY_MAX     (TASK_PRIORITY_LEVELS - 1)
+
+/* Affinity value letting a task run on any core */
+#define TASK_AFFINITY_ANY  (-1)
+
+/* Timeout value meaning "wait forever" */
+#define TASK_WAIT_FOREVER  0xFFFFFFFF
+
+/*
+ * Longest timeout, sleep or timer delay, in ticks (about 12.4 days at
+ * 1000 Hz). Deadlines are compared as signed 32-bit tick differences,
+ * so they must stay under 2^31 ticks ahead; the other half of that
+ * range covers whoever checks them running late.
+ */
+#define TASK_MAX_DELAY_TICKS  (1U << 30)
+
+/* Convert milliseconds to system ticks, rounding up and capping at TASK_MAX_DELAY_TICKS */
+static inline uint32_t ms_to_ticks(uint32_t ms)
+{
+    uint64_t ticks = ((uint64_t)ms * CONFIG_TICK_HZ + 999) / 1000;
+
+    return (uint32_t)MIN(ticks, (uint64_t)TASK_MAX_DELAY_TICKS);
+}
+
+/* How task_notify() updates the notification word */
+typedef enum {
+    TASK_NOTIFY_SET_BITS = 0,       /* OR in value */
+    TASK_NOTIFY_INCREMENT,          /* Add one, ignoring value */
+    TASK_NOTIFY_OVERWRITE           /* Replace with value */
+} task_notify_action_t;
+
+/* task_t.notify_state values */
+#define TASK_NOTIFY_NONE     0      /* Nothing pending */
+#define TASK_NOTIFY_WAITING  1      /* Blocked in task_notify_take/wait */
+#define TASK_NOTIFY_PENDING  2      /* Notified since the last take/wait */
+
+/* CPU accounting (CONFIG_SCHED_STATS) */
+typedef struct {
+    uint64_t run_cycles;            /* CCOUNT cycles spent running */
+    uint32_t voluntary;             /* Switched out blocking, sleeping or yielding */
+    uint32_t involuntary;           /* Switched out by preemption */
+} task_stats_t;
 
 /* Task entry point function type */
 typedef void (*task_entry_t)(void *arg);
 
 /* Task Control Block (TCB) */
-typedef struct {
+typedef struct task {
     uint32_t *stack_ptr;           /* Current stack pointer */
     task_entry_t entry;             /* Task entry function */
     void *arg;                      /* Task argument */
@@ -28,24 +86,227 @@ typedef struct {
     uint32_t stack_base;            /* Base address of stack */
     uint32_t stack_size;            /* Size of stack */
     uint32_t id;                    /* Task ID */
+    bool static_alloc;              /* TCB and stack belong to the caller */
+    uint32_t priority;              /* Scheduling priority, including inherited */
+    uint32_t base_priority;         /* Priority set by task_create/task_set_priority */
+    uint32_t core;                  /* Core whose run queue holds it / it last ran on */
+    int32_t affinity;               /* Core it must run on, or TASK_AFFINITY_ANY */
+    volatile bool wake_pending;     /* task_wake() arrived before it blocked */
+    bool timed_out;                 /* Last sleep ended at its deadline, not a task_wake() */
+    uint32_t time_slice;            /* Ticks per time slice (0 = unlimited) */
+    uint32_t slice_left;            /* Ticks left in the current slice */
+    uint32_t wake_tick;             /* Tick to wake at while sleeping */
+    struct task *sleep_next;        /* Next task in sleep queue */
+    struct task *sleep_prev;        /* Previous task in sleep queue */
+    struct task *wait_next;         /* Next task on a driver wait list or wait queue */
+    uint32_t wait_value;            /* Set by waitq_wake(), 0 while waiting */
+    uint32_t wait_bits;             /* Event bits waited for */
+    uint32_t wait_flags;            /* EVENT_WAIT_* flags of that wait */
+    volatile uint32_t notify_value; /* Notification word (task_notify) */
+    volatile uint8_t notify_state;  /* TASK_NOTIFY_NONE/WAITING/PENDING */
+    uint32_t fpu_state[TASK_FPU_STATE_WORDS];  /* FPU registers while not loaded in an FPU */
+    uint32_t run_start;             /* CCOUNT when last switched in */
+    uint32_t ready_since;           /* CCOUNT when woken, 0 once it has run */
+    task_stats_t stats;             /* CPU accounting */
+    struct mutex *blocked_on;       /* Mutex it is waiting for */
+    struct mutex *held_mutexes;     /* Mutexes it owns, for priority inheritance */
+    struct task *next;              /* Next task in ready queue, or exited task to reap */
+    struct task *prev;              /* Previous task in ready queue */
+    struct task *all_next;          /* Next task in the all-task list (by ID) */
+    struct task *all_prev;          /* Previous task in the all-task list */
 } task_t;
 
+/* Callback for task_for_each() */
+typedef void (*task_visit_t)(task_t *task, void *arg);
+
 /* Initialize task system */
 void task_init(void);
 
 /* Create a new task */
-task_t *task_create(const char *name, task_entry_t entry, void *arg, uint32_t stack_size);
+task_t *task_create(const char *name, task_entry_t entry, void *arg,
+                    uint32_t stack_size, uint32_t priority);
+
+/*
+ * Create a new task pinned to one core (or TASK_AFFINITY_ANY) from the
+ * start, so it never runs anywhere else, not even before it could be
+ * pinned with task_set_affinity().
+ */
+task_t *task_create_pinned(const char *name, task_entry_t entry, void *arg,
+                           uint32_t stack_size, uint32_t priority, int32_t core);
+
+/*
+ * Create a task in caller-provided memory: a TCB and a stack of
+ * stack_size bytes, aligned to TASK_STACK_ALIGN. Nothing comes from the
+ * heap. The memory must stay valid until the task has exited and been
+ * reaped; the kernel never frees it.
+ */
+task_t *task_create_static(task_t *task, const char *name, task_entry_t entry, void *arg,
+                           void *stack, uint32_t stack_size, uint32_t priority);
+
+/*
+ * Create a task that is only started once, at boot. With
+ * CONFIG_STATIC_TASKS its TCB and stack are static storage of this
+ * expansion (so don't use it in a loop), otherwise they come from the
+ * heap as with task_create(). stack_size must be a constant.
+ */
+#if CONFIG_STATIC_TASKS
+#define TASK_CREATE_BOOT(name, entry, arg, stack_size, priority) ({                 \
+    static task_t boot_tcb_;                                                        \
+    static uint8_t boot_stack_[stack_size] __attribute__((aligned(TASK_STACK_ALIGN))); \
+    task_create_static(&boot_tcb_, (name), (entry), (arg), boot_stack_,            \
+                       sizeof(boot_stack_), (priority));                            \
+})
+#else
+#define TASK_CREATE_BOOT(name, entry, arg, stack_size, priority)  \
+    task_create((name), (entry), (arg), (stack_size), (priority))
+#endif
+
+/*
+ * Change a task's base priority. While it holds a mutex it may keep
+ * running at a higher, inherited priority until it unlocks.
+ */
+void task_set_priority(task_t *task, uint32_t priority);
+
+/* Change the priority a task runs at now (scheduler_lock held, used for inheritance) */
+void task_set_priority_locked(task_t *task, uint32_t priority);
+
+/*
+ * Pin a task to one core, or let it run anywhere with TASK_AFFINITY_ANY.
+ * Returns false, leaving the affinity unchanged, for an invalid core or
+ * if the task is not running and its FPU registers are still loaded in
+ * another core's FPU. A task can always change its own affinity.
+ */
+bool task_set_affinity(task_t *task, int32_t core);
+
+/* Change a task's time slice (in ticks, 0 = never preempted by the tick) */
+void task_set_time_slice(task_t *task, uint32_t ticks);
+
+/* Put a task at the tail of its priority's ready queue */
+void task_make_ready(task_t *task);
 
-/* Get current running task */
+/* Highest priority this core could run next, or -1 if none */
+int task_ready_priority(void);
+
+/* Remove and return the highest-priority task this core can run */
+task_t *task_get_next_ready(void);
+
+/* Get the task running on this core */
 task_t *task_get_current(void);
 
-/* Set current running task */
+/* Get the task running on a given core */
+task_t *task_get_current_on(uint32_t core);
+
+/* Set the task running on this core */
 void task_set_current(task_t *task);
 
 /* Terminate current task */
 void task_exit(void);
 
+/*
+ * Stack high-water mark: bytes of the task's stack it has ever used
+ * (CONFIG_STACK_CHECK, otherwise the whole stack)
+ */
+uint32_t task_stack_used(task_t *task);
+
+/* Print every task's stack high-water mark against its stack size */
+void task_dump_stacks(void);
+
+/*
+ * Called on a switch away from a task whose lowest stack word has been
+ * overwritten: reports the overflow and halts
+ */
+void task_stack_overflow(task_t *task) __attribute__((noreturn));
+
+/* True while the lowest word of the task's stack still holds the fill pattern */
+static inline bool task_stack_intact(const task_t *task)
+{
+    return *(const volatile uint32_t *)task->stack_base == TASK_STACK_FILL;
+}
+
+/*
+ * Call fn for every task in ID order, exited ones included until they
+ * are reaped. No lock is held during fn, and no task is freed until the
+ * walk is over.
+ */
+void task_for_each(task_visit_t fn, void *arg);
+
+/* Queue an exited task for task_reap() once it is off its stack (scheduler_lock held) */
+void task_retire_locked(task_t *task);
+
+/*
+ * Free the TCBs and stacks of exited tasks and release their IDs.
+ * Called by the idle tasks and task_create(); never from a handler.
+ */
+void task_reap(void);
+
+/* Copy a task's CPU accounting, including its current run if it is running */
+void task_get_stats(task_t *task, task_stats_t *stats);
+
+/* Print every task's CPU load and switch counts */
+void task_dump_stats(void);
+
 /* Yield CPU to next task */
 void task_yield(void);
 
+/* Block the current task for at least ms milliseconds (at most TASK_MAX_DELAY_TICKS) */
+void task_sleep_ms(uint32_t ms);
+
+/* Block the current task until the system tick reaches wake_tick */
+void task_sleep_until(uint32_t wake_tick);
+
+/*
+ * Block the current task until task_wake() (call with interrupts masked).
+ * May return early for a wakeup meant for an earlier wait, so callers
+ * recheck their condition.
+ */
+void task_block(void);
+
+/* As task_block(), with a deadline; returns false if it passed first */
+bool task_block_until(uint32_t wake_tick);
+
+/* Make a blocked task ready again (safe from interrupt handlers) */
+void task_wake(task_t *task);
+
+/*
+ * Direct-to-task notifications: a 32-bit word in each task that
+ * task_notify() updates and the task itself waits on, with no kernel
+ * object in between. task_notify() is safe from interrupt handlers and
+ * either core; the take and wait calls are for the task itself and may
+ * be made with interrupts masked.
+ */
+
+/* Update a task's notification word and wake it if it is waiting */
+void task_notify(task_t *task, uint32_t value, task_notify_action_t action);
+
+/* Increment a task's notification word (counting-semaphore style) */
+static inline void task_notify_give(task_t *task)
+{
+    task_notify(task, 0, TASK_NOTIFY_INCREMENT);
+}
+
+/*
+ * Wait up to timeout_ms for the notification word to be nonzero, then
+ * return it, clearing it to zero if clear is set and decrementing it
+ * otherwise. Returns 0 on timeout.
+ */
+uint32_t task_notify_take(bool clear, uint32_t timeout_ms);
+
+/*
+ * Wait up to timeout_ms for a notification. Bits in clear_on_entry are
+ * cleared first unless one is already pending, and bits in clear_on_exit
+ * once one arrives. The word is stored to *value (if not NULL) either
+ * way. Returns false on timeout.
+ */
+bool task_notify_wait(uint32_t clear_on_entry, uint32_t clear_on_exit, uint32_t *value,
+                      uint32_t timeout_ms);
+
+/*
+ * Variants for code that already holds scheduler_lock with interrupts
+ * masked, so a wait can be queued and blocked on without a window for
+ * the waker. The block variants return with the lock released.
+ */
+void task_block_locked(void);
+bool task_block_until_locked(uint32_t wake_tick);
+void task_wake_locked(task_t *task);
+
 #endif /* TASK_H */
@@ -0,0 +1,69 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include "types.h"
+#include "task.h"
+
+/*
+ * Software timers.
+ *
+ * One-shot and periodic timers whose functions run in the high-priority
+ * "timer" task, at system tick resolution. Active timers sit in a
+ * hierarchical timing wheel (TIMER_WHEEL_LEVELS levels of
+ * TIMER_WHEEL_SLOTS slots, each level 32 times coarser than the one
+ * below), so timer_start() and timer_stop() are O(1) however many timers
+ * are active. The timer task sleeps until the wheel's next event, so in
+ * tickless idle CCOMPARE0 is programmed for the next timer rather than
+ * the next tick.
+ *
+ * timer_start() and timer_stop() are safe from interrupt handlers and
+ * either core. A timer function may block, but delays every timer due
+ * after it; it may restart or stop its own timer.
+ */
+
+/* Priority of the timer task */
+#define TIMER_TASK_PRIORITY     (TASK_PRIORITY_MAX - 1)
+
+#define TIMER_WHEEL_BITS        5
+#define TIMER_WHEEL_SLOTS       (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS      6   /* Covers 2^30 ticks; longer delays are re-filed */
+
+/* Timer function */
+typedef void (*timer_fn_t)(void *arg);
+
+typedef struct timer {
+    struct timer *next;             /* Next timer in the same wheel slot */
+    struct timer **pprev;           /* Link pointing at this timer, NULL when not active */
+    uint32_t expires;               /* Tick at which it fires */
+    uint32_t period;                /* Ticks between runs, 0 for a one-shot timer */
+    timer_fn_t fn;                  /* Function to run */
+    void *arg;                      /* Its argument */
+    uint16_t slot;                  /* Wheel slot (level * TIMER_WHEEL_SLOTS + index) */
+} timer_t;
+
+#define TIMER_INIT(fn, arg)  { NULL, NULL, 0, 0, (fn), (arg), 0 }
+
+/* Initialize a stopped timer that runs fn(arg) */
+void timer_init(timer_t *timer, timer_fn_t fn, void *arg);
+
+/*
+ * (Re)start a timer to fire after at least delay_ms, then every
+ * period_ms if period_ms is nonzero. Restarting an active timer moves
+ * its deadline. Delays and periods longer than TASK_MAX_DELAY_TICKS are cut
+ * to it.
+ */
+void timer_start(timer_t *timer, uint32_t delay_ms, uint32_t period_ms);
+
+/* Stop a timer, returns false if it wasn't active */
+bool timer_stop(timer_t *timer);
+
+/* Whether a timer is waiting to fire */
+static inline bool timer_active(const timer_t *timer)
+{
+    return timer->pprev != NULL;
+}
+
+/* Start the timer task */
+void timer_service_init(void);
+
+#endif /* TIMER_H */
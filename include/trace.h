@@ -0,0 +1,66 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "types.h"
+#include "config.h"
+
+/*
+ * Scheduler and interrupt event tracing (CONFIG_TRACE).
+ *
+ * Each event is two words in a per-core ring: the CCOUNT timestamp and
+ * an info word holding the event type, the core and one argument. A
+ * core only writes its own ring, with interrupts masked, so recording is
+ * a handful of stores. The rings keep the most recent events.
+ *
+ * trace_dump() prints the task names and the rings over the UART as
+ * "[TRACE]" text lines, which tools/trace_export turns into a Chrome
+ * trace (chrome://tracing or ui.perfetto.dev). With CONFIG_TRACE = 0
+ * the hooks compile to nothing.
+ */
+
+/* Events per core kept in the ring (power of two) */
+#define TRACE_BUFFER_EVENTS  512
+
+/* Event types; the argument is in brackets */
+#define TRACE_TASK_SWITCH_IN    1   /* Task ID */
+#define TRACE_TASK_SWITCH_OUT   2   /* Task ID */
+#define TRACE_TASK_CREATE       3   /* Task ID */
+#define TRACE_TASK_EXIT         4   /* Task ID */
+#define TRACE_ISR_ENTER         5   /* Interrupt number */
+#define TRACE_ISR_EXIT          6   /* Interrupt number */
+#define TRACE_HEAP_ALLOC        7   /* Block size in bytes */
+#define TRACE_HEAP_FREE         8   /* Block size in bytes */
+
+/* Info word layout */
+#define TRACE_EVENT_S           28
+#define TRACE_CORE_S            27
+#define TRACE_ARG_MASK          0x07FFFFFF
+
+#if CONFIG_TRACE
+
+/* Record one event on this core (use the TRACE macro) */
+void trace_record(uint32_t event, uint32_t arg);
+
+/* Start or stop recording (recording starts at boot) */
+void trace_start(void);
+void trace_stop(void);
+
+/* Stop recording, print the task names and the rings, then restart with empty rings */
+void trace_dump(void);
+
+#else
+
+static inline void trace_start(void) { }
+static inline void trace_stop(void) { }
+static inline void trace_dump(void) { }
+
+#endif /* CONFIG_TRACE */
+
+/* Host builds of kernel sources (tools/) never trace */
+#if CONFIG_TRACE && defined(__XTENSA__)
+#define TRACE(event, arg)  trace_record((event), (uint32_t)(arg))
+#else
+#define TRACE(event, arg)  do { } while (0)
+#endif
+
+#endif /* TRACE_H */
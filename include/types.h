@@ -16,6 +16,9 @@ typedef signed long long   int64_t;
 typedef unsigned int       size_t;
 typedef signed int         ssize_t;
 
+/* Pointer-sized integer */
+typedef unsigned long      uintptr_t;
+
 /* Boolean type */
 typedef enum {
     false = 0,
@@ -1,30 +1,85 @@
 #ifndef UART_H
 #define UART_H
 
+#include <stdarg.h>
 #include "types.h"
 
 /* UART configuration */
 #define UART_BAUD_RATE  115200
 
-/* Initialize UART0 for serial communication */
+/* Software TX buffer size (power of two) */
+#define UART_TX_BUFFER_SIZE  1024
+
+/* Refill the hardware TX FIFO when it drops below this many bytes */
+#define UART_TX_EMPTY_THRESHOLD  32
+
+/* Software RX buffer size (power of two) */
+#define UART_RX_BUFFER_SIZE  512
+
+/* Default RX interrupt thresholds (see uart_set_rx_thresholds) */
+#define UART_RX_FULL_THRESHOLD     64
+#define UART_RX_TIMEOUT_THRESHOLD  4
+
+/* What uart_putc does when the TX buffer is full */
+typedef enum {
+    UART_TX_DROP = 0,       /* Discard the new byte */
+    UART_TX_BLOCK,          /* Block the calling task until there is room */
+    UART_TX_OVERWRITE       /* Discard the oldest buffered byte */
+} uart_tx_policy_t;
+
+/* Initialize UART0 for serial communication (polled output) */
 void uart_init(void);
 
+/* Switch to interrupt-driven, buffered input and output */
+void uart_init_interrupts(void);
+
+/* Set the policy for writes to a full TX buffer */
+void uart_set_tx_policy(uart_tx_policy_t policy);
+
+/* Queue up to len bytes without blocking, returns the number accepted */
+size_t uart_write(const void *data, size_t len);
+
+/* Number of bytes discarded because the TX buffer was full */
+uint32_t uart_tx_dropped(void);
+
 /* Write a single character to UART */
 void uart_putc(char c);
 
 /* Write a null-terminated string to UART */
 void uart_puts(const char *str);
 
+/*
+ * Write a string straight to the hardware FIFO, bypassing the TX buffer
+ * and its lock. For fatal errors, where interrupts may be masked.
+ */
+void uart_puts_polled(const char *str);
+
 /* Read a character from UART (blocking) */
 char uart_getc(void);
 
+/*
+ * Read up to len bytes, blocking the calling task for up to timeout_ms
+ * (TASK_WAIT_FOREVER for no limit, 0 to poll) until at least one byte
+ * has arrived. Returns the number of bytes read.
+ */
+size_t uart_read(void *buf, size_t len, uint32_t timeout_ms);
+
+/*
+ * Set when the RX interrupt fires: once the hardware FIFO holds more than
+ * full_bytes, or after timeout_bytes byte times with no new data.
+ */
+void uart_set_rx_thresholds(uint32_t full_bytes, uint32_t timeout_bytes);
+
+/* Number of received bytes lost to a full RX buffer or FIFO overrun */
+uint32_t uart_rx_dropped(void);
+
 /* Check if data is available to read */
 bool uart_available(void);
 
-/* Simple printf-like function for formatted output */
-void uart_printf(const char *fmt, ...);
+/* printf-style formatted output (see kprintf.h for the supported conversions) */
+void uart_printf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
 
-/* Write formatted string with arguments */
-void uart_vprintf(const char *fmt, uint32_t *args);
+/* Formatted output with a va_list */
+void uart_vprintf(const char *fmt, va_list args);
 
 #endif /* UART_H */
@@ -0,0 +1,64 @@
+#ifndef WAITQ_H
+#define WAITQ_H
+
+#include "types.h"
+#include "task.h"
+
+/*
+ * Queues of tasks blocked on a kernel object.
+ *
+ * Tasks are linked through wait_next, so a task waits on at most one
+ * queue at a time. A waiter is released by waitq_wake(), which hands it
+ * a nonzero value saying what it got (a semaphore count, event bits).
+ * All operations are called with scheduler_lock held.
+ */
+
+/* Order in which waiters are released */
+typedef enum {
+    WAITQ_FIFO = 0,                 /* Arrival order */
+    WAITQ_PRIORITY                  /* Highest priority first, FIFO within a priority */
+} waitq_order_t;
+
+typedef struct {
+    task_t *head;                   /* Next task to release */
+    waitq_order_t order;
+} waitq_t;
+
+/* Initialize an empty queue */
+void waitq_init(waitq_t *wq, waitq_order_t order);
+
+/* Add a task in the queue's order */
+void waitq_insert(waitq_t *wq, task_t *task);
+
+/*
+ * Block the current task, already added with waitq_insert(), until
+ * waitq_wake() releases it or timeout_ms passes (TASK_WAIT_FOREVER to
+ * wait indefinitely). Returns the value passed to waitq_wake(), or 0 on
+ * timeout with the task taken off the queue. scheduler_lock is held
+ * again on return.
+ */
+uint32_t waitq_block(waitq_t *wq, uint32_t timeout_ms);
+
+/* Take a task off the queue and wake it with a nonzero value */
+void waitq_wake(waitq_t *wq, task_t *task, uint32_t value);
+
+/*
+ * Release scheduler_lock after waking waiters and restore ps. Called
+ * from a task, this yields to a woken task that outranks it; handlers
+ * leave that to interrupt exit.
+ */
+void waitq_unlock(uint32_t ps);
+
+/* Remove a task, returns false if it wasn't queued */
+bool waitq_remove(waitq_t *wq, task_t *task);
+
+/* Remove and return the next task to release, or NULL if empty */
+task_t *waitq_pop(waitq_t *wq);
+
+/* Next task to release, left queued */
+static inline task_t *waitq_peek(const waitq_t *wq)
+{
+    return wq->head;
+}
+
+#endif /* WAITQ_H */
@@ -0,0 +1,72 @@
+#ifndef WORKQUEUE_H
+#define WORKQUEUE_H
+
+#include "types.h"
+#include "task.h"
+
+/*
+ * Deferred work: interrupt handlers hand the slow part of their job to
+ * the high-priority "work" task instead of doing it with interrupts
+ * masked.
+ *
+ * A work item is embedded in the caller's own state, so submitting never
+ * allocates and can't fail for lack of space. work_submit() pushes it
+ * onto a list with S32C1I and only notifies the worker when the list was
+ * empty; the worker takes the whole list at once and runs every item in
+ * submission order, so one wakeup drains a burst. It is safe from
+ * interrupt handlers and either core. An item is queued at most once:
+ * submitting it again before it runs is a no-op, and it may resubmit
+ * itself from its function.
+ *
+ * Work runs in task context and may block, but a blocked item delays
+ * everything queued after it.
+ */
+
+/* Priority of the work task */
+#define WORK_TASK_PRIORITY      (TASK_PRIORITY_MAX - 1)
+
+/* Deferred function */
+typedef void (*work_fn_t)(void *arg);
+
+typedef struct work {
+    struct work *next;              /* Next item on the submit list */
+    work_fn_t fn;                   /* Function to run */
+    void *arg;                      /* Its argument */
+    volatile uint32_t pending;      /* Nonzero from submit until it starts running */
+    uint32_t submitted;             /* CCOUNT at submit */
+} work_t;
+
+/* Worker statistics, all kept by the work task */
+typedef struct {
+    uint32_t completed;             /* Items run */
+    uint32_t wakeups;               /* Times the worker woke to drain the list */
+    uint32_t depth_max;             /* Most items taken off the list at once */
+    uint32_t batch_max;             /* Most items run in one wakeup */
+    uint32_t latency_max;           /* Longest submit to completion, in CCOUNT cycles */
+    uint64_t latency_total;         /* Sum of submit to completion, in CCOUNT cycles */
+} work_stats_t;
+
+#define WORK_INIT(fn, arg)  { NULL, (fn), (arg), 0, 0 }
+
+/* Initialize a work item that runs fn(arg) */
+void work_init(work_t *work, work_fn_t fn, void *arg);
+
+/* Queue a work item, returns false if it is already queued */
+bool work_submit(work_t *work);
+
+/* Whether a work item is queued and hasn't started running yet */
+static inline bool work_pending(const work_t *work)
+{
+    return work->pending != 0;
+}
+
+/* Start the work task */
+void workqueue_init(void);
+
+/* Copy the worker statistics */
+void work_stats(work_stats_t *stats);
+
+/* Print the worker statistics */
+void work_dump_stats(void);
+
+#endif /* WORKQUEUE_H */
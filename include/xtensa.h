@@ -0,0 +1,209 @@
+#ifndef XTENSA_H
+#define XTENSA_H
+
+/* Xtensa LX6 processor definitions shared by C and assembly */
+
+/* ===== PS Register ===== */
+#define PS_INTLEVEL(n)          ((n) & 0xF)
+#define PS_INTLEVEL_MASK        0x0000000F
+#define PS_EXCM                 0x00000010
+#define PS_UM                   0x00000020
+#define PS_CALLINC(n)           (((n) & 0x3) << 16)
+#define PS_WOE                  0x00040000
+
+/* Highest interrupt level masked while PS.EXCM is set */
+#define XCHAL_EXCM_LEVEL        3
+
+/* ===== Exception Causes ===== */
+#define EXCCAUSE_LEVEL1_INTERRUPT   4
+#define EXCCAUSE_CP0_DISABLED       32  /* FPU instruction with CPENABLE bit 0 clear */
+
+/* CPENABLE bit of the FPU (coprocessor 0) */
+#define XT_CPENABLE_FPU             0x01
+
+/*
+ * Task context frame.
+ *
+ * Every switched-out task has one of these at its saved stack pointer,
+ * whether it was preempted by an interrupt or switched out by
+ * context_switch. Only the register window in use at the time is saved
+ * here; all older windows are spilled to their own stack frames first.
+ * The top 16 bytes are left alone: they are the base save area the
+ * interrupted function's caller spills a0-a3 into.
+ */
+#define XT_STK_PC               0x00
+#define XT_STK_PS               0x04
+#define XT_STK_A0               0x08
+#define XT_STK_A1               0x0C
+#define XT_STK_A2               0x10
+#define XT_STK_A3               0x14
+#define XT_STK_A4               0x18
+#define XT_STK_A5               0x1C
+#define XT_STK_A6               0x20
+#define XT_STK_A7               0x24
+#define XT_STK_A8               0x28
+#define XT_STK_A9               0x2C
+#define XT_STK_A10              0x30
+#define XT_STK_A11              0x34
+#define XT_STK_A12              0x38
+#define XT_STK_A13              0x3C
+#define XT_STK_A14              0x40
+#define XT_STK_A15              0x44
+#define XT_STK_SAR              0x48
+#define XT_STK_LBEG             0x4C
+#define XT_STK_LEND             0x50
+#define XT_STK_LCOUNT           0x54
+#define XT_STK_EXCCAUSE         0x58
+#define XT_STK_EXCVADDR         0x5C
+#define XT_STK_FRMSZ            0x70    /* 0x60 of registers + base save area */
+
+#ifdef __ASSEMBLER__
+
+/*
+ * Spill every live register window except the current one to the stack.
+ * Touching a12 after each rotation raises window overflow exceptions for
+ * any frame still held in the register file (64 AREGs = 16 rotations).
+ * Requires PS.WOE=1 and PS.EXCM=0.
+ */
+    .macro SPILL_ALL_WINDOWS
+    and a12, a12, a12
+    rotw 3
+    and a12, a12, a12
+    rotw 3
+    and a12, a12, a12
+    rotw 3
+    and a12, a12, a12
+    rotw 3
+    and a12, a12, a12
+    rotw 4
+    .endm
+
+#else
+
+#include "types.h"
+
+/*
+ * Mask interrupts up to XCHAL_EXCM_LEVEL and return the previous PS.
+ * This covers every level that may run kernel code; pair with
+ * xt_irq_restore() so sections can nest and be entered from handlers.
+ */
+static inline uint32_t xt_irq_save(void)
+{
+    uint32_t ps;
+    __asm__ volatile ("rsil %0, %1" : "=a" (ps) : "i" (XCHAL_EXCM_LEVEL) : "memory");
+    return ps;
+}
+
+/* Restore the PS returned by xt_irq_save() */
+static inline void xt_irq_restore(uint32_t ps)
+{
+    __asm__ volatile ("wsr %0, ps\n"
+                      "rsync\n"
+                      : : "a" (ps) : "memory");
+}
+
+/* Index of the executing core: 0 on the PRO CPU, 1 on the APP CPU (PRID bit 13) */
+static inline uint32_t xt_core_id(void)
+{
+    uint32_t id;
+    __asm__ ("rsr %0, prid\n"
+             "extui %0, %0, 13, 1\n"
+             : "=a" (id));
+    return id;
+}
+
+/*
+ * Atomic compare-and-set with S32C1I: stores value at addr if it holds
+ * expected. Returns the previous contents (== expected on success).
+ */
+static inline uint32_t xt_compare_set(volatile uint32_t *addr, uint32_t expected, uint32_t value)
+{
+    __asm__ volatile ("wsr %2, scompare1\n"
+                      "s32c1i %0, %1, 0\n"
+                      : "+a" (value) : "a" (addr), "a" (expected) : "memory");
+    return value;
+}
+
+/* Read the cycle counter */
+static inline uint32_t xt_get_ccount(void)
+{
+    uint32_t value;
+    __asm__ volatile ("rsr %0, ccount" : "=a" (value));
+    return value;
+}
+
+/* Write the cycle counter */
+static inline void xt_set_ccount(uint32_t value)
+{
+    __asm__ volatile ("wsr %0, ccount\n"
+                      "rsync\n"
+                      : : "a" (value));
+}
+
+/* Read timer compare register 0 */
+static inline uint32_t xt_get_ccompare0(void)
+{
+    uint32_t value;
+    __asm__ volatile ("rsr %0, ccompare0" : "=a" (value));
+    return value;
+}
+
+/* Write timer compare register 0 (also clears its interrupt) */
+static inline void xt_set_ccompare0(uint32_t value)
+{
+    __asm__ volatile ("wsr %0, ccompare0\n"
+                      "rsync\n"
+                      : : "a" (value));
+}
+
+/* Read the enabled interrupt mask */
+static inline uint32_t xt_get_intenable(void)
+{
+    uint32_t value;
+    __asm__ volatile ("rsr %0, intenable" : "=a" (value));
+    return value;
+}
+
+/* Write the enabled interrupt mask */
+static inline void xt_set_intenable(uint32_t value)
+{
+    __asm__ volatile ("wsr %0, intenable\n"
+                      "rsync\n"
+                      : : "a" (value));
+}
+
+/* Read the pending interrupt mask */
+static inline uint32_t xt_get_interrupt(void)
+{
+    uint32_t value;
+    __asm__ volatile ("rsr %0, interrupt" : "=a" (value));
+    return value;
+}
+
+/* Enable or disable coprocessors (CPENABLE bits) */
+static inline void xt_set_cpenable(uint32_t mask)
+{
+    __asm__ volatile ("wsr %0, cpenable\n"
+                      "rsync\n"
+                      : : "a" (mask) : "memory");
+}
+
+/* Raise software interrupts */
+static inline void xt_set_intset(uint32_t mask)
+{
+    __asm__ volatile ("wsr %0, intset\n"
+                      "rsync\n"
+                      : : "a" (mask));
+}
+
+/* Clear pending software and edge-triggered interrupts */
+static inline void xt_set_intclear(uint32_t mask)
+{
+    __asm__ volatile ("wsr %0, intclear\n"
+                      "rsync\n"
+                      : : "a" (mask));
+}
+
+#endif /* __ASSEMBLER__ */
+
+#endif /* XTENSA_H */
@@ -0,0 +1,493 @@
+#include "task.h"
+#include "kernel.h"
+#include "interrupt.h"
+#include "uart.h"
+#include "kprintf.h"
+#include "queue.h"
+#include "workqueue.h"
+#include "smp.h"
+#include "esp32_defs.h"
+#include "xtensa.h"
+
+/*
+ * On-target benchmarks, enabled with CONFIG_BENCHMARKS=1.
+ *
+ * A single task runs each benchmark once after boot, prints the results
+ * in CCOUNT cycles and exits.
+ */
+
+#define BENCH_FORMAT_ITERATIONS  1000
+#define BENCH_QUEUE_MESSAGES     10000
+#define BENCH_QUEUE_CAPACITY     64
+#define BENCH_NOTIFY_ITERATIONS  1000
+#define BENCH_YIELD_ITERATIONS   1000
+#define BENCH_WORK_ITERATIONS    1000
+
+/* Keep the compiler from dropping work whose result is never read */
+#define BENCH_BARRIER()  __asm__ volatile ("" : : : "memory")
+
+/* ===== Formatting: previous uart_vprintf core vs kvformat ===== */
+
+/* The pre-kprintf itoa, kept for comparison (one division per digit) */
+static void legacy_itoa(int32_t value, char *buffer, int base)
+{
+    char *ptr = buffer;
+    char *ptr1 = buffer;
+    char tmp_char;
+    int32_t tmp_value;
+
+    if (value == 0) {
+        *ptr++ = '0';
+        *ptr = '\0';
+        return;
+    }
+
+    if (value < 0 && base == 10) {
+        *ptr++ = '-';
+        ptr1++;
+        value = -value;
+    }
+
+    while (value) {
+        tmp_value = value;
+        value /= base;
+        *ptr++ = "0123456789abcdef"[tmp_value - value * base];
+    }
+
+    *ptr-- = '\0';
+
+    while (ptr1 < ptr) {
+        tmp_char = *ptr;
+        *ptr-- = *ptr1;
+        *ptr1++ = tmp_char;
+    }
+}
+
+/* Byte-at-a-time sink standing in for uart_putc */
+typedef struct {
+    char *buf;
+    size_t size;
+    size_t len;
+} legacy_sink_t;
+
+static void legacy_putc(legacy_sink_t *sink, char c)
+{
+    if (sink->len + 1 < sink->size) {
+        sink->buf[sink->len++] = c;
+    }
+}
+
+static void legacy_puts(legacy_sink_t *sink, const char *str)
+{
+    while (*str) {
+        legacy_putc(sink, *str++);
+    }
+}
+
+/* The pre-kprintf uart_vprintf, taking its arguments as an explicit word array */
+static void legacy_vprintf(legacy_sink_t *sink, const char *fmt, const uint32_t *args)
+{
+    char buffer[32];
+    int arg_index = 0;
+
+    while (*fmt) {
+        if (*fmt == '%') {
+            fmt++;
+            switch (*fmt) {
+                case 'd':
+                case 'i':
+                    legacy_itoa((int32_t)args[arg_index++], buffer, 10);
+                    legacy_puts(sink, buffer);
+                    break;
+                case 'u':
+                    legacy_itoa((uint32_t)args[arg_index++], buffer, 10);
+                    legacy_puts(sink, buffer);
+                    break;
+                case 'x':
+                    legacy_itoa((uint32_t)args[arg_index++], buffer, 16);
+                    legacy_puts(sink, buffer);
+                    break;
+                case 's':
+                    legacy_puts(sink, (const char *)args[arg_index++]);
+                    break;
+                case 'c':
+                    legacy_putc(sink, (char)args[arg_index++]);
+                    break;
+                case '%':
+                    legacy_putc(sink, '%');
+                    break;
+                default:
+                    legacy_putc(sink, '%');
+                    legacy_putc(sink, *fmt);
+                    break;
+            }
+        } else {
+            legacy_putc(sink, *fmt);
+        }
+        fmt++;
+    }
+    sink->buf[sink->len] = '\0';
+}
+
+static void bench_format(void)
+{
+    static const char fmt[] = "[TASK] Created task '%s' (ID: %d, priority: %d, stack: %x)\n";
+    const char *name = "uart_status";
+    uint32_t args[] = { (uint32_t)name, 12345, 8, 0x3FFB4A20 };
+    char buf[96];
+    uint32_t start, legacy_cycles, new_cycles;
+
+    start = xt_get_ccount();
+    for (int i = 0; i < BENCH_FORMAT_ITERATIONS; i++) {
+        legacy_sink_t sink = { buf, sizeof(buf), 0 };
+        legacy_vprintf(&sink, fmt, args);
+        BENCH_BARRIER();
+    }
+    legacy_cycles = xt_get_ccount() - start;
+
+    start = xt_get_ccount();
+    for (int i = 0; i < BENCH_FORMAT_ITERATIONS; i++) {
+        ksnprintf(buf, sizeof(buf), fmt, name, 12345, 8, 0x3FFB4A20);
+        BENCH_BARRIER();
+    }
+    new_cycles = xt_get_ccount() - start;
+
+    uart_printf("[BENCH] format: legacy %u cycles/call, ksnprintf %u cycles/call\n",
+                legacy_cycles / BENCH_FORMAT_ITERATIONS, new_cycles / BENCH_FORMAT_ITERATIONS);
+
+    /* Integer conversion alone: divide per digit vs reciprocal multiply */
+    start = xt_get_ccount();
+    for (int i = 0; i < BENCH_FORMAT_ITERATIONS; i++) {
+        legacy_itoa(2000000000U - i, buf, 10);
+        BENCH_BARRIER();
+    }
+    legacy_cycles = xt_get_ccount() - start;
+
+    start = xt_get_ccount();
+    for (int i = 0; i < BENCH_FORMAT_ITERATIONS; i++) {
+        ksnprintf(buf, sizeof(buf), "%u", 2000000000U - i);
+        BENCH_BARRIER();
+    }
+    new_cycles = xt_get_ccount() - start;
+
+    uart_printf("[BENCH] %%u 2000000000: legacy %u cycles/call, ksnprintf %u cycles/call\n",
+                legacy_cycles / BENCH_FORMAT_ITERATIONS, new_cycles / BENCH_FORMAT_ITERATIONS);
+
+    /* Handing one formatted line to the UART: per byte vs one bulk write */
+    int len = ksnprintf(buf, sizeof(buf), fmt, name, 12345, 8, 0x3FFB4A20);
+
+    start = xt_get_ccount();
+    for (int i = 0; i < len; i++) {
+        uart_putc(buf[i]);
+    }
+    legacy_cycles = xt_get_ccount() - start;
+
+    start = xt_get_ccount();
+    uart_write(buf, len);
+    new_cycles = xt_get_ccount() - start;
+
+    uart_printf("[BENCH] %d byte line to UART: uart_putc loop %u cycles, uart_write %u cycles\n",
+                len, legacy_cycles, new_cycles);
+}
+
+/* ===== Context switch: cycles per task_yield ===== */
+
+/* Second benchmark task and the queues it feeds */
+static task_t *bench_peer;
+static spsc_queue_t *bench_spsc;
+static mpmc_queue_t *bench_mpmc;
+
+/* Print min / mean / max of a set of cycle samples */
+static void bench_report(const char *what, uint32_t min, uint64_t total, uint32_t max, uint32_t count)
+{
+    uart_printf("[BENCH] %s: min %u mean %u max %u cycles\n",
+                what, min, (uint32_t)(total / count), max);
+}
+
+/* Pin the calling task to a core and move there, reporting a failure */
+static bool bench_pin(int32_t core)
+{
+    if (!task_set_affinity(task_get_current(), core)) {
+        uart_printf("[BENCH] ERROR: Failed to pin to core %d\n", core);
+        return false;
+    }
+    task_yield();
+    return true;
+}
+
+static void bench_queue_produce(void);
+
+/*
+ * Second benchmark task: yields back to the benchmark task for the
+ * switch benchmark, then feeds the cross-core queue benchmark from
+ * core 1 once notified.
+ */
+static void bench_peer_task(void *arg)
+{
+    for (int i = 0; i < BENCH_YIELD_ITERATIONS; i++) {
+        task_yield();
+    }
+
+    task_notify_take(true, TASK_WAIT_FOREVER);
+    bench_queue_produce();
+}
+
+static void bench_switch(void)
+{
+    task_t *self = task_get_current();
+    uint32_t priority = self->base_priority;
+    uint32_t min = 0xFFFFFFFF, max = 0;
+    uint64_t total = 0;
+
+    /* Stay on core 0, above the demo tasks, so only the two benchmark tasks take turns */
+    if (!bench_pin(0)) {
+        return;
+    }
+    task_set_priority(self, TASK_PRIORITY_HIGH + 1);
+
+    /* Nothing else ready at this priority: yield returns without switching */
+    for (int i = 0; i < BENCH_YIELD_ITERATIONS; i++) {
+        uint32_t start = xt_get_ccount();
+        task_yield();
+        uint32_t cycles = xt_get_ccount() - start;
+        min = MIN(min, cycles);
+        max = MAX(max, cycles);
+        total += cycles;
+    }
+    bench_report("task_yield, no switch", min, total, max, BENCH_YIELD_ITERATIONS);
+
+    /* Pinned from creation: unpinned, core 1 could start its yields first */
+    bench_peer = task_create_pinned("bench_peer", bench_peer_task, NULL, TASK_STACK_SIZE,
+                                    TASK_PRIORITY_HIGH + 1, 0);
+    if (!bench_peer) {
+        uart_puts("[BENCH] ERROR: Failed to create peer task\n");
+        task_set_priority(self, priority);
+        return;
+    }
+
+    /* Each yield switches to the peer, whose yield switches back: two per sample */
+    min = 0xFFFFFFFF;
+    max = 0;
+    total = 0;
+    for (int i = 0; i < BENCH_YIELD_ITERATIONS; i++) {
+        uint32_t start = xt_get_ccount();
+        task_yield();
+        uint32_t cycles = (xt_get_ccount() - start) / 2;
+        min = MIN(min, cycles);
+        max = MAX(max, cycles);
+        total += cycles;
+    }
+    bench_report("task_yield, switch", min, total, max, BENCH_YIELD_ITERATIONS);
+
+    task_set_priority(self, priority);
+}
+
+/* ===== Message queues: SPSC vs MPMC, one core and across cores ===== */
+
+/* Peer side of the cross-core queue benchmark: streams through the SPSC queue, then the MPMC one */
+static void bench_queue_produce(void)
+{
+    /* If it can't move, the receiver still gets every message, just from this core */
+    task_set_priority(bench_peer, TASK_PRIORITY_NORMAL);
+    bench_pin(1);
+
+    for (uint32_t i = 0; i < BENCH_QUEUE_MESSAGES; i++) {
+        spsc_queue_send(bench_spsc, &i, TASK_WAIT_FOREVER);
+    }
+    for (uint32_t i = 0; i < BENCH_QUEUE_MESSAGES; i++) {
+        mpmc_queue_send(bench_mpmc, &i, TASK_WAIT_FOREVER);
+    }
+}
+
+/* Messages per second from a count and the CCOUNT cycles they took */
+static uint32_t bench_rate(uint32_t messages, uint32_t cycles)
+{
+    return cycles ? (uint32_t)((uint64_t)messages * CPU_CLK_FREQ / cycles) : 0;
+}
+
+static void bench_queue(void)
+{
+    uint32_t msg, start, spsc_cycles, mpmc_cycles;
+
+    bench_spsc = spsc_queue_create(sizeof(uint32_t), BENCH_QUEUE_CAPACITY);
+    bench_mpmc = mpmc_queue_create(sizeof(uint32_t), BENCH_QUEUE_CAPACITY);
+    if (!bench_spsc || !bench_mpmc) {
+        uart_puts("[BENCH] ERROR: Failed to create queues\n");
+        return;
+    }
+
+    /* One core: send and receive back to back, nobody ever waits */
+    start = xt_get_ccount();
+    for (uint32_t i = 0; i < BENCH_QUEUE_MESSAGES; i++) {
+        spsc_queue_try_send(bench_spsc, &i);
+        spsc_queue_try_recv(bench_spsc, &msg);
+    }
+    spsc_cycles = xt_get_ccount() - start;
+
+    start = xt_get_ccount();
+    for (uint32_t i = 0; i < BENCH_QUEUE_MESSAGES; i++) {
+        mpmc_queue_try_send(bench_mpmc, &i);
+        mpmc_queue_try_recv(bench_mpmc, &msg);
+    }
+    mpmc_cycles = xt_get_ccount() - start;
+
+    uart_printf("[BENCH] queue, one core: SPSC %u msgs/s (%u cycles/msg), MPMC %u msgs/s (%u cycles/msg)\n",
+                bench_rate(BENCH_QUEUE_MESSAGES, spsc_cycles), spsc_cycles / BENCH_QUEUE_MESSAGES,
+                bench_rate(BENCH_QUEUE_MESSAGES, mpmc_cycles), mpmc_cycles / BENCH_QUEUE_MESSAGES);
+
+    if (smp_cores_online() < 2 || !bench_peer) {
+        return;
+    }
+
+    /* Across cores: receive here on core 0 from the peer task moved to core 1 */
+    if (!bench_pin(0)) {
+        return;
+    }
+    task_notify_give(bench_peer);
+
+    /* Time from the first message to the last, so startup isn't counted */
+    spsc_queue_recv(bench_spsc, &msg, TASK_WAIT_FOREVER);
+    start = xt_get_ccount();
+    for (uint32_t i = 1; i < BENCH_QUEUE_MESSAGES; i++) {
+        spsc_queue_recv(bench_spsc, &msg, TASK_WAIT_FOREVER);
+    }
+    spsc_cycles = xt_get_ccount() - start;
+
+    mpmc_queue_recv(bench_mpmc, &msg, TASK_WAIT_FOREVER);
+    start = xt_get_ccount();
+    for (uint32_t i = 1; i < BENCH_QUEUE_MESSAGES; i++) {
+        mpmc_queue_recv(bench_mpmc, &msg, TASK_WAIT_FOREVER);
+    }
+    mpmc_cycles = xt_get_ccount() - start;
+
+    uart_printf("[BENCH] queue, core 1 -> core 0: SPSC %u msgs/s, MPMC %u msgs/s\n",
+                bench_rate(BENCH_QUEUE_MESSAGES - 1, spsc_cycles),
+                bench_rate(BENCH_QUEUE_MESSAGES - 1, mpmc_cycles));
+
+    task_set_affinity(task_get_current(), TASK_AFFINITY_ANY);
+}
+
+/* ===== Task notification: interrupt handler to task wake latency ===== */
+
+static task_t *bench_notify_task;
+static volatile uint32_t bench_irq_ccount;
+
+/* Software interrupt handler: timestamp, then notify the benchmark task */
+static void bench_notify_isr(void *arg)
+{
+    xt_set_intclear(BIT(XT_SOFTWARE0_INUM));
+    bench_irq_ccount = xt_get_ccount();
+    task_notify_give(bench_notify_task);
+}
+
+static void bench_notify(void)
+{
+    task_t *self = task_get_current();
+    uint32_t priority = self->base_priority;
+    uint32_t min = 0xFFFFFFFF, max = 0;
+    uint64_t total = 0;
+
+    /* Stay on core 0, where the software interrupt is enabled, above the demo tasks */
+    if (!bench_pin(0)) {
+        return;
+    }
+    task_set_priority(self, TASK_PRIORITY_MAX);
+
+    bench_notify_task = self;
+    interrupt_register_handler(XT_SOFTWARE0_INUM, bench_notify_isr, NULL);
+    interrupt_enable_source(XT_SOFTWARE0_INUM);
+
+    for (int i = 0; i < BENCH_NOTIFY_ITERATIONS; i++) {
+        /* Raised now, taken by whatever runs once this task has blocked */
+        uint32_t ps = interrupt_disable();
+        xt_set_intset(BIT(XT_SOFTWARE0_INUM));
+        task_notify_take(true, TASK_WAIT_FOREVER);
+        uint32_t cycles = xt_get_ccount() - bench_irq_ccount;
+        interrupt_restore(ps);
+
+        min = MIN(min, cycles);
+        max = MAX(max, cycles);
+        total += cycles;
+    }
+
+    interrupt_disable_source(XT_SOFTWARE0_INUM);
+    interrupt_unregister_handler(XT_SOFTWARE0_INUM);
+    task_set_priority(self, priority);
+    task_set_affinity(self, TASK_AFFINITY_ANY);
+
+    bench_report("notify, handler to task", min, total, max, BENCH_NOTIFY_ITERATIONS);
+}
+
+/* ===== Deferred work: interrupt handler to work item latency ===== */
+
+static work_t bench_work_item;
+static uint32_t bench_work_cycles;
+
+/* Software interrupt handler: timestamp, then defer to the work task */
+static void bench_work_isr(void *arg)
+{
+    xt_set_intclear(BIT(XT_SOFTWARE0_INUM));
+    bench_irq_ccount = xt_get_ccount();
+    work_submit(&bench_work_item);
+}
+
+/* Work item: record the latency and release the benchmark task */
+static void bench_work_fn(void *arg)
+{
+    bench_work_cycles = xt_get_ccount() - bench_irq_ccount;
+    task_notify_give((task_t *)arg);
+}
+
+static void bench_work(void)
+{
+    task_t *self = task_get_current();
+    uint32_t min = 0xFFFFFFFF, max = 0;
+    uint64_t total = 0;
+
+    /* The software interrupt is only routed on core 0 */
+    if (!bench_pin(0)) {
+        return;
+    }
+
+    work_init(&bench_work_item, bench_work_fn, self);
+    interrupt_register_handler(XT_SOFTWARE0_INUM, bench_work_isr, NULL);
+    interrupt_enable_source(XT_SOFTWARE0_INUM);
+
+    for (int i = 0; i < BENCH_WORK_ITERATIONS; i++) {
+        xt_set_intset(BIT(XT_SOFTWARE0_INUM));
+        task_notify_take(true, TASK_WAIT_FOREVER);
+        uint32_t cycles = bench_work_cycles;
+
+        min = MIN(min, cycles);
+        max = MAX(max, cycles);
+        total += cycles;
+    }
+
+    interrupt_disable_source(XT_SOFTWARE0_INUM);
+    interrupt_unregister_handler(XT_SOFTWARE0_INUM);
+    task_set_affinity(self, TASK_AFFINITY_ANY);
+
+    bench_report("work, handler to work item", min, total, max, BENCH_WORK_ITERATIONS);
+}
+
+/* Benchmark task: runs every benchmark once, then exits */
+static void bench_task(void *arg)
+{
+    uart_puts("[BENCH] Running benchmarks...\n");
+
+    bench_format();
+    bench_switch();
+    bench_queue();
+    bench_notify();
+    bench_work();
+
+    uart_puts("[BENCH] Done\n");
+}
+
+/* Create the benchmark task */
+void bench_init_tasks(void)
+{
+    if (!TASK_CREATE_BOOT("bench", bench_task, NULL, TASK_STACK_SIZE, TASK_PRIORITY_NORMAL)) {
+        uart_puts("[BENCH] ERROR: Failed to create benchmark task\n");
+    }
+}
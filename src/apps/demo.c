@@ -2,6 +2,13 @@
 #include "kernel.h"
 #include "uart.h"
 #include "gpio.h"
+#include "heap.h"
+#include "pool.h"
+#include "smp.h"
+#include "mutex.h"
+#include "trace.h"
+#include "interrupt.h"
+#include "workqueue.h"
 #include "esp32_defs.h"
 
 /* LED GPIO pin - most ESP32 boards have LED on GPIO2 */
@@ -26,21 +33,15 @@ void led_blink_task(void *arg)
         gpio_set_level(LED_GPIO, GPIO_LEVEL_HIGH);
         uart_printf("[LED_TASK] LED ON (blink #%d)\n", ++blink_count);
 
-        /* Delay ~500ms */
-        for (volatile int i = 0; i < 50; i++) {
-            delay_ms(10);
-            task_yield();  /* Allow other tasks to run */
-        }
+        /* Sleep 500ms (other tasks run meanwhile) */
+        task_sleep_ms(500);
 
         /* Turn LED off */
         gpio_set_level(LED_GPIO, GPIO_LEVEL_LOW);
         uart_puts("[LED_TASK] LED OFF\n");
 
-        /* Delay ~500ms */
-        for (volatile int i = 0; i < 50; i++) {
-            delay_ms(10);
-            task_yield();  /* Allow other tasks to run */
-        }
+        /* Sleep 500ms (other tasks run meanwhile) */
+        task_sleep_ms(500);
     }
 }
 
@@ -53,20 +54,50 @@ void uart_status_task(void *arg)
 
     while (1) {
         /* Print status message */
-        uart_printf("[UART_TASK] Status update #%d - System running OK\n", ++counter);
+        uart_printf("[UART_TASK] Status update #%d - System running OK (up %llu ms)\n",
+                    ++counter, scheduler_get_time_us() / 1000);
 
-        /* Delay ~2 seconds */
-        for (volatile int i = 0; i < 200; i++) {
-            delay_ms(10);
-            task_yield();  /* Allow other tasks to run */
-        }
+        /* Sleep 2 seconds */
+        task_sleep_ms(2000);
 
         /* Print heap statistics periodically */
         if (counter % 5 == 0) {
             uint32_t total, used, free;
-            extern void heap_stats(uint32_t *total, uint32_t *used, uint32_t *free);
             heap_stats(&total, &used, &free);
             uart_printf("[UART_TASK] Heap: %d bytes used, %d bytes free\n", used, free);
+            pool_dump_stats();
+
+            for (uint32_t core = 0; core < smp_cores_online(); core++) {
+                uint64_t idle, elapsed;
+                uint32_t sleeps;
+                scheduler_idle_stats(core, &idle, &elapsed, &sleeps);
+                uart_printf("[UART_TASK] Core %d idle: %d%% of CPU, %d sleeps\n", core,
+                            elapsed ? (uint32_t)(idle * 100 / elapsed) : 0, sleeps);
+            }
+
+            if (CONFIG_STACK_CHECK) {
+                task_dump_stacks();
+            }
+
+            if (CONFIG_SCHED_STATS) {
+                task_dump_stats();
+                scheduler_dump_latency();
+            }
+
+            if (CONFIG_IRQ_STATS) {
+                interrupt_dump_stats();
+            }
+
+            work_dump_stats();
+
+            if (CONFIG_LOCK_STATS) {
+                spin_lock_dump_stats("scheduler", &scheduler_lock);
+                mutex_dump_stats();
+            }
+
+            if (CONFIG_TRACE) {
+                trace_dump();
+            }
         }
     }
 }
@@ -108,19 +139,22 @@ void compute_task(void *arg)
 void demo_init_tasks(void)
 {
     /* Create LED blink task */
-    task_t *led_task = task_create("led_blink", led_blink_task, NULL, TASK_STACK_SIZE);
+    task_t *led_task = TASK_CREATE_BOOT("led_blink", led_blink_task, NULL, TASK_STACK_SIZE,
+                                        TASK_PRIORITY_HIGH);
     if (!led_task) {
         uart_puts("[DEMO] ERROR: Failed to create LED task\n");
     }
 
     /* Create UART status task */
-    task_t *uart_task = task_create("uart_status", uart_status_task, NULL, TASK_STACK_SIZE);
+    task_t *uart_task = TASK_CREATE_BOOT("uart_status", uart_status_task, NULL, TASK_STACK_SIZE,
+                                         TASK_PRIORITY_HIGH);
     if (!uart_task) {
         uart_puts("[DEMO] ERROR: Failed to create UART task\n");
     }
 
-    /* Create compute task */
-    task_t *compute = task_create("compute", compute_task, NULL, TASK_STACK_SIZE);
+    /* Create compute task below the I/O tasks so it only fills idle time */
+    task_t *compute = TASK_CREATE_BOOT("compute", compute_task, NULL, TASK_STACK_SIZE,
+                                       TASK_PRIORITY_NORMAL);
     if (!compute) {
         uart_puts("[DEMO] ERROR: Failed to create compute task\n");
     }
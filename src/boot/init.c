@@ -7,7 +7,7 @@ extern void kernel_main(void);
 /* Initialize system hardware and clocks */
 void init_system(void)
 {
-    /* Disable APP CPU (we only use PRO CPU for this kernel) */
+    /* Keep the APP CPU parked until the scheduler starts it (smp.c) */
     REG_WRITE(DPORT_APPCPU_CTRL_B_REG, 0);
 
     /* Initialize UART for early debugging */
@@ -1,53 +1,42 @@
 #include "uart.h"
 #include "esp32_defs.h"
+#include "xtensa.h"
+#include "interrupt.h"
+#include "task.h"
+#include "kernel.h"
+#include "kprintf.h"
+#include "spinlock.h"
 
-/* Simple strlen implementation */
-static size_t strlen(const char *str)
-{
-    size_t len = 0;
-    while (str[len] != '\0') {
-        len++;
-    }
-    return len;
-}
+#define TX_BUFFER_MASK  (UART_TX_BUFFER_SIZE - 1)
 
-/* Simple itoa implementation (integer to ASCII) */
-static void itoa(int32_t value, char *buffer, int base)
-{
-    char *ptr = buffer;
-    char *ptr1 = buffer;
-    char tmp_char;
-    int32_t tmp_value;
+/* Wake blocked writers once this much of the TX buffer is free */
+#define TX_WAKE_SPACE   (UART_TX_BUFFER_SIZE / 2)
 
-    if (value == 0) {
-        *ptr++ = '0';
-        *ptr = '\0';
-        return;
-    }
+/*
+ * TX ring buffer, drained into the hardware FIFO by the TXFIFO_EMPTY
+ * interrupt. head and tail are free-running; head - tail is the fill
+ * level. Both ends, the RX ring and the wait lists are only touched
+ * with uart_lock held, since writers may run on either core.
+ */
+static spinlock_t uart_lock = SPINLOCK_INIT;
+static char tx_buffer[UART_TX_BUFFER_SIZE];
+static volatile uint32_t tx_head = 0;
+static volatile uint32_t tx_tail = 0;
+static bool irq_mode = false;           /* Set once uart_init_interrupts() has run */
+static uart_tx_policy_t tx_policy = UART_TX_BLOCK;
+static uint32_t tx_dropped_count = 0;
 
-    /* Handle negative numbers for base 10 */
-    if (value < 0 && base == 10) {
-        *ptr++ = '-';
-        ptr1++;
-        value = -value;
-    }
-
-    /* Convert to string in reverse order */
-    while (value) {
-        tmp_value = value;
-        value /= base;
-        *ptr++ = "0123456789abcdef"[tmp_value - value * base];
-    }
+/* Tasks blocked on a full buffer */
+static task_t *tx_waiters = NULL;
 
-    *ptr-- = '\0';
+#define RX_BUFFER_MASK  (UART_RX_BUFFER_SIZE - 1)
 
-    /* Reverse the string */
-    while (ptr1 < ptr) {
-        tmp_char = *ptr;
-        *ptr-- = *ptr1;
-        *ptr1++ = tmp_char;
-    }
-}
+/* RX ring buffer, filled by the RXFIFO_FULL and RX timeout interrupts */
+static char rx_buffer[UART_RX_BUFFER_SIZE];
+static volatile uint32_t rx_head = 0;
+static volatile uint32_t rx_tail = 0;
+static uint32_t rx_dropped_count = 0;
+static task_t *rx_waiters = NULL;
 
 /* Initialize UART0 */
 void uart_init(void)
@@ -76,90 +65,437 @@ void uart_init(void)
     /* The ROM bootloader already configured these pins */
 }
 
+/* Bytes waiting in the hardware TX FIFO */
+static inline uint32_t uart_txfifo_count(void)
+{
+    return (REG_READ(UART_STATUS_REG(0)) >> UART_TXFIFO_CNT_S) & UART_TXFIFO_CNT;
+}
+
+/* Write a character straight to the hardware FIFO, waiting for space */
+static void uart_putc_polled(char c)
+{
+    while (uart_txfifo_count() >= 126);
+
+    REG_WRITE(UART_FIFO_REG(0), c);
+}
+
+/* Move buffered bytes into the hardware FIFO (uart_lock held) */
+static void uart_tx_fill(void)
+{
+    uint32_t room = UART_FIFO_SIZE - uart_txfifo_count();
+
+    while (room > 0 && tx_tail != tx_head) {
+        REG_WRITE(UART_FIFO_REG(0), tx_buffer[tx_tail & TX_BUFFER_MASK]);
+        tx_tail++;
+        room--;
+    }
+}
+
+/* Make every task on a wait list ready (uart_lock held) */
+static void uart_wake_all(task_t **waiters)
+{
+    task_t *task = *waiters;
+
+    *waiters = NULL;
+    while (task) {
+        task_t *next = task->wait_next;
+        task_wake(task);
+        task = next;
+    }
+}
+
+/* Take a task off a wait list if it is still on it (uart_lock held) */
+static void uart_wait_remove(task_t **waiters, task_t *task)
+{
+    for (task_t **link = waiters; *link; link = &(*link)->wait_next) {
+        if (*link == task) {
+            *link = task->wait_next;
+            return;
+        }
+    }
+}
+
+/* Bytes waiting in the hardware RX FIFO */
+static inline uint32_t uart_rxfifo_count(void)
+{
+    return (REG_READ(UART_STATUS_REG(0)) >> UART_RXFIFO_CNT_S) & UART_RXFIFO_CNT;
+}
+
+/* Move received bytes from the hardware FIFO into the RX buffer */
+static void uart_rx_drain(void)
+{
+    uint32_t count = uart_rxfifo_count();
+
+    while (count-- > 0) {
+        char c = (char)(REG_READ(UART_FIFO_REG(0)) & 0xFF);
+
+        if (rx_head - rx_tail < UART_RX_BUFFER_SIZE) {
+            rx_buffer[rx_head & RX_BUFFER_MASK] = c;
+            rx_head++;
+        } else {
+            rx_dropped_count++;
+        }
+    }
+}
+
+/* Arm TXFIFO_EMPTY so the interrupt keeps draining the buffer */
+static inline void uart_tx_kick(void)
+{
+    REG_WRITE(UART_INT_ENA_REG(0), REG_READ(UART_INT_ENA_REG(0)) | UART_TXFIFO_EMPTY_INT);
+}
+
+/* UART0 interrupt handler */
+static void uart_isr(void *arg)
+{
+    uint32_t ps = spin_lock_irqsave(&uart_lock);
+
+    uint32_t status = REG_READ(UART_INT_ST_REG(0));
+
+    if (status & UART_TXFIFO_EMPTY_INT) {
+        uart_tx_fill();
+
+        /* Nothing left to send: stop the interrupt until the next write */
+        if (tx_head == tx_tail) {
+            REG_WRITE(UART_INT_ENA_REG(0), REG_READ(UART_INT_ENA_REG(0)) & ~UART_TXFIFO_EMPTY_INT);
+        }
+        REG_WRITE(UART_INT_CLR_REG(0), UART_TXFIFO_EMPTY_INT);
+
+        /* Let blocked writers retry once there is a useful amount of room */
+        if (tx_waiters && UART_TX_BUFFER_SIZE - (tx_head - tx_tail) >= TX_WAKE_SPACE) {
+            uart_wake_all(&tx_waiters);
+        }
+    }
+
+    if (status & (UART_RXFIFO_FULL_INT | UART_RXFIFO_TOUT_INT | UART_RXFIFO_OVF_INT)) {
+        if (status & UART_RXFIFO_OVF_INT) {
+            rx_dropped_count++;
+        }
+
+        uart_rx_drain();
+        REG_WRITE(UART_INT_CLR_REG(0), UART_RXFIFO_FULL_INT | UART_RXFIFO_TOUT_INT |
+                                       UART_RXFIFO_OVF_INT);
+
+        if (rx_head != rx_tail) {
+            uart_wake_all(&rx_waiters);
+        }
+    }
+
+    spin_unlock_irqrestore(&uart_lock, ps);
+}
+
+/* Set the RX interrupt thresholds */
+void uart_set_rx_thresholds(uint32_t full_bytes, uint32_t timeout_bytes)
+{
+    full_bytes = MIN(MAX(full_bytes, 1), UART_FIFO_SIZE - 1);
+    timeout_bytes = MIN(MAX(timeout_bytes, 1), UART_RX_TOUT_THRHD);
+
+    uint32_t conf1 = REG_READ(UART_CONF1_REG(0));
+    conf1 &= ~((UART_RXFIFO_FULL_THRHD << UART_RXFIFO_FULL_THRHD_S) |
+               (UART_RX_TOUT_THRHD << UART_RX_TOUT_THRHD_S));
+    conf1 |= (full_bytes << UART_RXFIFO_FULL_THRHD_S) |
+             (timeout_bytes << UART_RX_TOUT_THRHD_S) | UART_RX_TOUT_EN;
+    REG_WRITE(UART_CONF1_REG(0), conf1);
+}
+
+/* Switch to interrupt-driven, buffered input and output */
+void uart_init_interrupts(void)
+{
+    /* Refill the hardware FIFO before it runs dry */
+    uint32_t conf1 = REG_READ(UART_CONF1_REG(0));
+    conf1 &= ~(UART_TXFIFO_EMPTY_THRHD << UART_TXFIFO_EMPTY_THRHD_S);
+    conf1 |= UART_TX_EMPTY_THRESHOLD << UART_TXFIFO_EMPTY_THRHD_S;
+    REG_WRITE(UART_CONF1_REG(0), conf1);
+    uart_set_rx_thresholds(UART_RX_FULL_THRESHOLD, UART_RX_TIMEOUT_THRESHOLD);
+
+    REG_WRITE(UART_INT_ENA_REG(0), 0);
+    REG_WRITE(UART_INT_CLR_REG(0), 0xFFFFFFFF);
+
+    /* Route UART0 through the interrupt matrix to a level-1 CPU interrupt */
+    REG_WRITE(DPORT_PRO_UART_INTR_MAP_REG, ETS_UART0_INUM);
+    interrupt_register_handler(ETS_UART0_INUM, uart_isr, NULL);
+
+    tx_head = 0;
+    tx_tail = 0;
+    rx_head = 0;
+    rx_tail = 0;
+    irq_mode = true;
+    REG_WRITE(UART_INT_ENA_REG(0), UART_RXFIFO_FULL_INT | UART_RXFIFO_TOUT_INT | UART_RXFIFO_OVF_INT);
+    interrupt_enable_source(ETS_UART0_INUM);
+
+    uart_printf("[UART] Interrupt-driven I/O enabled (TX %d, RX %d byte buffers)\n",
+                UART_TX_BUFFER_SIZE, UART_RX_BUFFER_SIZE);
+}
+
+/* Set the policy for writes to a full TX buffer */
+void uart_set_tx_policy(uart_tx_policy_t policy)
+{
+    tx_policy = policy;
+}
+
+/* Number of received bytes lost to a full RX buffer or FIFO overrun */
+uint32_t uart_rx_dropped(void)
+{
+    return rx_dropped_count;
+}
+
+/* Number of bytes discarded because the TX buffer was full */
+uint32_t uart_tx_dropped(void)
+{
+    return tx_dropped_count;
+}
+
 /* Write a single character to UART */
 void uart_putc(char c)
 {
-    /* Wait until TX FIFO has space */
-    while (((REG_READ(UART_STATUS_REG(0)) >> UART_TXFIFO_CNT_S) & UART_TXFIFO_CNT) >= 126);
+    if (!irq_mode) {
+        uart_putc_polled(c);
+        return;
+    }
 
-    /* Write character to FIFO */
-    REG_WRITE(UART_FIFO_REG(0), c);
+    uint32_t ps = spin_lock_irqsave(&uart_lock);
+
+    /* Nothing queued ahead of us and room in the hardware FIFO */
+    if (tx_head == tx_tail && uart_txfifo_count() < UART_FIFO_SIZE) {
+        REG_WRITE(UART_FIFO_REG(0), c);
+        spin_unlock_irqrestore(&uart_lock, ps);
+        return;
+    }
+
+    while (tx_head - tx_tail >= UART_TX_BUFFER_SIZE) {
+        if (tx_policy == UART_TX_DROP) {
+            tx_dropped_count++;
+            spin_unlock_irqrestore(&uart_lock, ps);
+            return;
+        }
+
+        if (tx_policy == UART_TX_OVERWRITE) {
+            tx_tail++;
+            tx_dropped_count++;
+            break;
+        }
+
+        task_t *current = task_get_current();
+        if (current && (ps & PS_INTLEVEL_MASK) == 0) {
+            /* Sleep until the interrupt has drained half the buffer */
+            current->wait_next = tx_waiters;
+            tx_waiters = current;
+            spin_unlock(&uart_lock);
+            task_block();
+            spin_lock(&uart_lock);
+            uart_wait_remove(&tx_waiters, current);
+        } else {
+            /* Can't sleep in a handler, a masked section or before the scheduler */
+            while (uart_txfifo_count() >= UART_FIFO_SIZE);
+            uart_tx_fill();
+        }
+    }
+
+    tx_buffer[tx_head & TX_BUFFER_MASK] = c;
+    tx_head++;
+    uart_tx_kick();
+
+    spin_unlock_irqrestore(&uart_lock, ps);
+}
+
+/* Queue up to len bytes without blocking, returns the number accepted */
+size_t uart_write(const void *data, size_t len)
+{
+    const char *bytes = (const char *)data;
+    size_t count = 0;
+
+    if (!irq_mode) {
+        while (count < len) {
+            uart_putc_polled(bytes[count++]);
+        }
+        return count;
+    }
+
+    uint32_t ps = spin_lock_irqsave(&uart_lock);
+
+    /* Whatever the hardware FIFO can take right away skips the buffer */
+    if (tx_head == tx_tail) {
+        uint32_t room = UART_FIFO_SIZE - uart_txfifo_count();
+        while (count < len && room > 0) {
+            REG_WRITE(UART_FIFO_REG(0), bytes[count++]);
+            room--;
+        }
+    }
+
+    while (count < len && tx_head - tx_tail < UART_TX_BUFFER_SIZE) {
+        tx_buffer[tx_head & TX_BUFFER_MASK] = bytes[count++];
+        tx_head++;
+    }
+
+    if (tx_head != tx_tail) {
+        uart_tx_kick();
+    }
+
+    spin_unlock_irqrestore(&uart_lock, ps);
+
+    return count;
+}
+
+/* Write all of data, applying the TX policy once the buffer is full */
+static void uart_write_all(const char *data, size_t len)
+{
+    size_t sent = uart_write(data, len);
+
+    while (sent < len) {
+        uart_putc(data[sent++]);
+    }
 }
 
 /* Write a null-terminated string to UART */
 void uart_puts(const char *str)
+{
+    while (*str) {
+        const char *line = str;
+        while (*str && *str != '\n') {
+            str++;
+        }
+        uart_write_all(line, str - line);
+
+        if (*str == '\n') {
+            uart_write_all("\r\n", 2);  /* Convert \n to \r\n */
+            str++;
+        }
+    }
+}
+
+/* Write a string straight to the hardware FIFO */
+void uart_puts_polled(const char *str)
 {
     while (*str) {
         if (*str == '\n') {
-            uart_putc('\r');  /* Convert \n to \r\n */
+            uart_putc_polled('\r');
         }
-        uart_putc(*str++);
+        uart_putc_polled(*str++);
     }
 }
 
 /* Read a character from UART (blocking) */
 char uart_getc(void)
 {
+    char c;
+
+    if (irq_mode) {
+        while (uart_read(&c, 1, TASK_WAIT_FOREVER) == 0);
+        return c;
+    }
+
     /* Wait until RX FIFO has data */
-    while (((REG_READ(UART_STATUS_REG(0)) >> UART_RXFIFO_CNT_S) & UART_RXFIFO_CNT) == 0);
+    while (uart_rxfifo_count() == 0);
 
     /* Read character from FIFO */
     return (char)(REG_READ(UART_FIFO_REG(0)) & 0xFF);
 }
 
+/* Read up to len bytes, waiting up to timeout_ms for the first one */
+size_t uart_read(void *buf, size_t len, uint32_t timeout_ms)
+{
+    char *bytes = (char *)buf;
+    size_t count = 0;
+
+    if (!irq_mode) {
+        while (count < len && uart_rxfifo_count() > 0) {
+            bytes[count++] = (char)(REG_READ(UART_FIFO_REG(0)) & 0xFF);
+        }
+        return count;
+    }
+
+    uint32_t deadline = scheduler_get_ticks() + ms_to_ticks(timeout_ms) + 1;
+    uint32_t ps = spin_lock_irqsave(&uart_lock);
+
+    /* Don't wait for the RX timeout to pick up a short tail still in the FIFO */
+    if (rx_head == rx_tail) {
+        uart_rx_drain();
+    }
+
+    while (rx_head == rx_tail && timeout_ms != 0) {
+        task_t *current = task_get_current();
+        if (!current || (ps & PS_INTLEVEL_MASK) != 0) {
+            break;
+        }
+
+        current->wait_next = rx_waiters;
+        rx_waiters = current;
+
+        /* Interrupts stay masked, so only the other core can get in before we block */
+        bool woken = true;
+        spin_unlock(&uart_lock);
+        if (timeout_ms == TASK_WAIT_FOREVER) {
+            task_block();
+        } else {
+            woken = task_block_until(deadline);
+        }
+        spin_lock(&uart_lock);
+
+        /* Still listed if something other than the interrupt woke us */
+        uart_wait_remove(&rx_waiters, current);
+        if (!woken) {
+            break;
+        }
+    }
+
+    while (count < len && rx_tail != rx_head) {
+        bytes[count++] = rx_buffer[rx_tail & RX_BUFFER_MASK];
+        rx_tail++;
+    }
+
+    spin_unlock_irqrestore(&uart_lock, ps);
+
+    return count;
+}
+
 /* Check if data is available to read */
 bool uart_available(void)
 {
-    return ((REG_READ(UART_STATUS_REG(0)) >> UART_RXFIFO_CNT_S) & UART_RXFIFO_CNT) > 0;
+    return rx_head != rx_tail || uart_rxfifo_count() > 0;
 }
 
-/* Simple printf-like function */
-void uart_printf(const char *fmt, ...)
+/* Staging buffer that turns formatted chunks into bulk UART writes */
+typedef struct {
+    char data[64];
+    size_t len;
+} uart_fmt_buffer_t;
+
+static void uart_fmt_flush(uart_fmt_buffer_t *b)
 {
-    uint32_t *args = ((uint32_t *)&fmt) + 1;
-    uart_vprintf(fmt, args);
+    uart_write_all(b->data, b->len);
+    b->len = 0;
 }
 
-/* Formatted output with variadic arguments */
-void uart_vprintf(const char *fmt, uint32_t *args)
-{
-    char buffer[32];
-    int arg_index = 0;
-
-    while (*fmt) {
-        if (*fmt == '%') {
-            fmt++;
-            switch (*fmt) {
-                case 'd':  /* Decimal integer */
-                case 'i':
-                    itoa((int32_t)args[arg_index++], buffer, 10);
-                    uart_puts(buffer);
-                    break;
-                case 'u':  /* Unsigned integer */
-                    itoa((uint32_t)args[arg_index++], buffer, 10);
-                    uart_puts(buffer);
-                    break;
-                case 'x':  /* Hexadecimal */
-                    itoa((uint32_t)args[arg_index++], buffer, 16);
-                    uart_puts(buffer);
-                    break;
-                case 's':  /* String */
-                    uart_puts((char *)args[arg_index++]);
-                    break;
-                case 'c':  /* Character */
-                    uart_putc((char)args[arg_index++]);
-                    break;
-                case '%':  /* Literal % */
-                    uart_putc('%');
-                    break;
-                default:
-                    uart_putc('%');
-                    uart_putc(*fmt);
-                    break;
-            }
-        } else {
-            uart_putc(*fmt);
+static void uart_fmt_out(void *ctx, const char *data, size_t len)
+{
+    uart_fmt_buffer_t *b = (uart_fmt_buffer_t *)ctx;
+
+    for (size_t i = 0; i < len; i++) {
+        if (b->len + 2 > sizeof(b->data)) {
+            uart_fmt_flush(b);
+        }
+        if (data[i] == '\n') {
+            b->data[b->len++] = '\r';
         }
-        fmt++;
+        b->data[b->len++] = data[i];
     }
 }
+
+/* Formatted output (see kprintf.h for the supported conversions) */
+void uart_printf(const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    uart_vprintf(fmt, args);
+    va_end(args);
+}
+
+/* Formatted output with a va_list */
+void uart_vprintf(const char *fmt, va_list args)
+{
+    uart_fmt_buffer_t b;
+
+    b.len = 0;
+    kvformat(uart_fmt_out, &b, fmt, args);
+    uart_fmt_flush(&b);
+}
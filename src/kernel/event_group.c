@@ -0,0 +1,102 @@
+#include "event_group.h"
+#include "kernel.h"
+#include "xtensa.h"
+
+/* Whether set satisfies a wait for bits with flags */
+static bool event_group_satisfied(uint32_t set, uint32_t bits, uint32_t flags)
+{
+    if (flags & EVENT_WAIT_ALL) {
+        return (set & bits) == bits;
+    }
+    return (set & bits) != 0;
+}
+
+/* Initialize an event group */
+void event_group_init(event_group_t *group, const char *name, waitq_order_t order)
+{
+    group->name = name;
+    group->bits = 0;
+    waitq_init(&group->waiters, order);
+}
+
+/* Set bits and wake the waiters now satisfied */
+uint32_t event_group_set(event_group_t *group, uint32_t bits)
+{
+    uint32_t ps = spin_lock_irqsave(&scheduler_lock);
+    uint32_t clear = 0;
+
+    group->bits |= bits;
+
+    /* Every waiter sees the bits as set here, even ones another clears */
+    task_t *task = waitq_peek(&group->waiters);
+    while (task) {
+        task_t *next = task->wait_next;
+
+        if (event_group_satisfied(group->bits, task->wait_bits, task->wait_flags)) {
+            if (task->wait_flags & EVENT_WAIT_CLEAR) {
+                clear |= task->wait_bits;
+            }
+            waitq_wake(&group->waiters, task, group->bits);
+        }
+        task = next;
+    }
+
+    group->bits &= ~clear;
+    uint32_t result = group->bits;
+
+    waitq_unlock(ps);
+    return result;
+}
+
+/* Clear bits */
+uint32_t event_group_clear(event_group_t *group, uint32_t bits)
+{
+    uint32_t ps = spin_lock_irqsave(&scheduler_lock);
+    uint32_t old = group->bits;
+    group->bits &= ~bits;
+    spin_unlock_irqrestore(&scheduler_lock, ps);
+
+    return old;
+}
+
+/* Currently set bits */
+uint32_t event_group_get(const event_group_t *group)
+{
+    return group->bits;
+}
+
+/* Wait for any or all of bits */
+uint32_t event_group_wait(event_group_t *group, uint32_t bits, uint32_t flags,
+                          uint32_t timeout_ms)
+{
+    if (bits == 0) {
+        return 0;
+    }
+
+    uint32_t ps = spin_lock_irqsave(&scheduler_lock);
+
+    if (event_group_satisfied(group->bits, bits, flags)) {
+        uint32_t result = group->bits;
+        if (flags & EVENT_WAIT_CLEAR) {
+            group->bits &= ~bits;
+        }
+        spin_unlock_irqrestore(&scheduler_lock, ps);
+        return result;
+    }
+
+    /* Only a task with interrupts enabled can block */
+    task_t *current = task_get_current_on(xt_core_id());
+    if (timeout_ms == 0 || !current || (ps & PS_INTLEVEL_MASK) != 0) {
+        spin_unlock_irqrestore(&scheduler_lock, ps);
+        return 0;
+    }
+
+    /* event_group_set checks the condition and does any clearing for us */
+    current->wait_bits = bits;
+    current->wait_flags = flags;
+    waitq_insert(&group->waiters, current);
+    uint32_t result = waitq_block(&group->waiters, timeout_ms);
+
+    spin_unlock_irqrestore(&scheduler_lock, ps);
+    return result;
+}
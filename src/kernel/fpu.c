@@ -0,0 +1,76 @@
+#include "fpu.h"
+#include "config.h"
+#include "xtensa.h"
+
+/* Task whose registers are loaded in each core's FPU, if any */
+static task_t *volatile fpu_owner[CONFIG_NUM_CORES];
+
+/* Save a core's FPU owner into its TCB and leave the FPU unowned */
+static void fpu_flush(uint32_t core)
+{
+    task_t *owner = fpu_owner[core];
+
+    xt_set_cpenable(XT_CPENABLE_FPU);
+    fpu_save(owner->fpu_state);
+    xt_set_cpenable(0);
+    fpu_owner[core] = NULL;
+}
+
+/*
+ * Runs with interrupts masked, so the current task can't be switched out
+ * halfway through the exchange.
+ */
+void fpu_exception(void)
+{
+    uint32_t core = xt_core_id();
+    task_t *current = task_get_current_on(core);
+    task_t *owner = fpu_owner[core];
+
+    xt_set_cpenable(XT_CPENABLE_FPU);
+
+    if (!current || owner == current) {
+        return;
+    }
+
+    if (owner) {
+        fpu_save(owner->fpu_state);
+    }
+    fpu_restore(current->fpu_state);
+    fpu_owner[core] = current;
+}
+
+void fpu_switch_out(task_t *task)
+{
+    uint32_t core = xt_core_id();
+
+    if (fpu_owner[core] != task) {
+        return;
+    }
+
+    if (task->state == TASK_STATE_TERMINATED) {
+        fpu_owner[core] = NULL;
+    } else if (task->affinity != (int32_t)core) {
+        fpu_flush(core);
+    }
+}
+
+bool fpu_prepare_move(task_t *task, int32_t core)
+{
+    uint32_t self = xt_core_id();
+
+    /* A running task is saved when it is switched out */
+    if (task->state == TASK_STATE_RUNNING) {
+        return true;
+    }
+
+    for (uint32_t i = 0; i < CONFIG_NUM_CORES; i++) {
+        if (fpu_owner[i] != task || (int32_t)i == core) {
+            continue;
+        }
+        if (i != self) {
+            return false;
+        }
+        fpu_flush(i);
+    }
+    return true;
+}
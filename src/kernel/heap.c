@@ -1,45 +1,248 @@
 #include "heap.h"
 #include "esp32_defs.h"
 #include "uart.h"
+#include "log.h"
+#include "spinlock.h"
+#include "trace.h"
+
+/*
+ * Two-level segregated fit (TLSF) allocator.
+ *
+ * Free blocks are kept in segregated lists indexed by a first-level
+ * (power of two) and second-level (linear subdivision) size class.
+ * Two bitmaps record which lists are non-empty, so finding a fitting
+ * block is a couple of bit scans instead of a list walk. Every block
+ * carries a pointer to its physical predecessor (boundary tag), so
+ * kfree can coalesce with both neighbours in constant time.
+ */
 
 /* Heap memory block header */
 typedef struct heap_block {
-    size_t size;                    /* Size of this block (excluding header) */
-    bool is_free;                   /* Is this block free? */
-    struct heap_block *next;        /* Next block in list */
+    struct heap_block *prev_phys;   /* Physically preceding block */
+    size_t size;                    /* Payload size, low bits hold flags */
+    struct heap_block *next_free;   /* Next free block (free blocks only) */
+    struct heap_block *prev_free;   /* Previous free block (free blocks only) */
 } heap_block_t;
 
-#define HEAP_BLOCK_HEADER_SIZE sizeof(heap_block_t)
-#define ALIGN_SIZE 4
+/* Free list links live in the payload, so only the first two fields cost memory */
+#define HEAP_BLOCK_HEADER_SIZE  __builtin_offsetof(heap_block_t, next_free)
+#define HEAP_BLOCK_MIN_SIZE     (sizeof(heap_block_t) - HEAP_BLOCK_HEADER_SIZE)
+
+/* Block flags stored in the low bits of size */
+#define HEAP_BLOCK_FREE         0x1
+#define HEAP_BLOCK_FLAGS        0x3
+
+#define ALIGN_SIZE              sizeof(void *)
+
+/* Size class configuration */
+#define SL_INDEX_COUNT_LOG2     4       /* 16 second-level lists per class */
+#define SL_INDEX_COUNT          (1 << SL_INDEX_COUNT_LOG2)
+#define FL_INDEX_MAX            20      /* Largest block: 1MB */
+#define FL_INDEX_SHIFT          (SL_INDEX_COUNT_LOG2 + 2)
+#define FL_INDEX_COUNT          (FL_INDEX_MAX - FL_INDEX_SHIFT + 1)
+#define SMALL_BLOCK_SIZE        (1 << FL_INDEX_SHIFT)
+#define HEAP_BLOCK_MAX_SIZE     (1 << FL_INDEX_MAX)
 
 /* Heap start and end from linker script */
 extern uint32_t _heap_start;
 extern uint32_t _heap_end;
 
-/* Heap state */
-static heap_block_t *heap_head = NULL;
+/* Heap state, guarded by heap_lock (kmalloc and kfree may run on either core) */
+static spinlock_t heap_lock = SPINLOCK_INIT;
+static uint32_t fl_bitmap = 0;
+static uint32_t sl_bitmap[FL_INDEX_COUNT];
+static heap_block_t *free_lists[FL_INDEX_COUNT][SL_INDEX_COUNT];
 static uint32_t heap_size = 0;
-static uint32_t heap_used = 0;
+static uint32_t heap_free_bytes = 0;
 
-/* Align size to 4-byte boundary */
+/* Align size to the heap alignment */
 static size_t align_size(size_t size)
 {
     return (size + ALIGN_SIZE - 1) & ~(ALIGN_SIZE - 1);
 }
 
+/* Index of the most significant set bit (NSAU on Xtensa) */
+static inline int heap_fls(uint32_t word)
+{
+    return word ? 31 - __builtin_clz(word) : -1;
+}
+
+/* Index of the least significant set bit */
+static inline int heap_ffs(uint32_t word)
+{
+    return heap_fls(word & (~word + 1));
+}
+
+static inline size_t block_size(const heap_block_t *block)
+{
+    return block->size & ~HEAP_BLOCK_FLAGS;
+}
+
+static inline bool block_is_free(const heap_block_t *block)
+{
+    return (block->size & HEAP_BLOCK_FREE) ? true : false;
+}
+
+static inline void *block_to_ptr(heap_block_t *block)
+{
+    return (uint8_t *)block + HEAP_BLOCK_HEADER_SIZE;
+}
+
+static inline heap_block_t *block_from_ptr(void *ptr)
+{
+    return (heap_block_t *)((uint8_t *)ptr - HEAP_BLOCK_HEADER_SIZE);
+}
+
+/* Physically following block */
+static inline heap_block_t *block_next(heap_block_t *block)
+{
+    return (heap_block_t *)((uint8_t *)block_to_ptr(block) + block_size(block));
+}
+
+/* Map a block size to its free list */
+static void mapping_insert(size_t size, int *fli, int *sli)
+{
+    int fl, sl;
+
+    if (size < SMALL_BLOCK_SIZE) {
+        fl = 0;
+        sl = size / (SMALL_BLOCK_SIZE / SL_INDEX_COUNT);
+    } else {
+        fl = heap_fls(size);
+        sl = (size >> (fl - SL_INDEX_COUNT_LOG2)) ^ SL_INDEX_COUNT;
+        fl -= FL_INDEX_SHIFT - 1;
+    }
+
+    *fli = fl;
+    *sli = sl;
+}
+
+/* Map a request to the first list whose blocks are all large enough */
+static void mapping_search(size_t size, int *fli, int *sli)
+{
+    if (size >= SMALL_BLOCK_SIZE) {
+        size += (1 << (heap_fls(size) - SL_INDEX_COUNT_LOG2)) - 1;
+    }
+    mapping_insert(size, fli, sli);
+}
+
+/* Find a non-empty list at or above (fl, sl) */
+static heap_block_t *find_suitable_block(int *fli, int *sli)
+{
+    int fl = *fli;
+    int sl;
+    uint32_t sl_map;
+
+    if (fl >= FL_INDEX_COUNT) {
+        return NULL;
+    }
+
+    sl_map = sl_bitmap[fl] & (~0U << *sli);
+    if (!sl_map) {
+        /* Nothing in this class, take the next larger non-empty class */
+        uint32_t fl_map = fl_bitmap & (~0U << (fl + 1));
+        if (!fl_map) {
+            return NULL;
+        }
+        fl = heap_ffs(fl_map);
+        sl_map = sl_bitmap[fl];
+    }
+    sl = heap_ffs(sl_map);
+
+    *fli = fl;
+    *sli = sl;
+    return free_lists[fl][sl];
+}
+
+static void remove_free_block(heap_block_t *block, int fl, int sl)
+{
+    heap_block_t *prev = block->prev_free;
+    heap_block_t *next = block->next_free;
+
+    if (next) {
+        next->prev_free = prev;
+    }
+    if (prev) {
+        prev->next_free = next;
+    } else {
+        free_lists[fl][sl] = next;
+        if (!next) {
+            sl_bitmap[fl] &= ~BIT(sl);
+            if (!sl_bitmap[fl]) {
+                fl_bitmap &= ~BIT(fl);
+            }
+        }
+    }
+
+    heap_free_bytes -= block_size(block);
+}
+
+static void insert_free_block(heap_block_t *block)
+{
+    int fl, sl;
+
+    mapping_insert(block_size(block), &fl, &sl);
+
+    block->prev_free = NULL;
+    block->next_free = free_lists[fl][sl];
+    if (block->next_free) {
+        block->next_free->prev_free = block;
+    }
+    free_lists[fl][sl] = block;
+    fl_bitmap |= BIT(fl);
+    sl_bitmap[fl] |= BIT(sl);
+
+    heap_free_bytes += block_size(block);
+}
+
+static void unlink_free_block(heap_block_t *block)
+{
+    int fl, sl;
+
+    mapping_insert(block_size(block), &fl, &sl);
+    remove_free_block(block, fl, sl);
+}
+
+/* Initialize the allocator over an explicit memory region */
+void heap_init_region(void *start, size_t size)
+{
+    uint8_t *base = (uint8_t *)ALIGN_UP((uintptr_t)start, ALIGN_SIZE);
+    size = ALIGN_DOWN(size - (base - (uint8_t *)start), ALIGN_SIZE);
+
+    fl_bitmap = 0;
+    for (int fl = 0; fl < FL_INDEX_COUNT; fl++) {
+        sl_bitmap[fl] = 0;
+        for (int sl = 0; sl < SL_INDEX_COUNT; sl++) {
+            free_lists[fl][sl] = NULL;
+        }
+    }
+
+    heap_size = size;
+    heap_free_bytes = 0;
+
+    /* One free block spanning the region, terminated by a used sentinel */
+    size_t payload = size - 2 * HEAP_BLOCK_HEADER_SIZE;
+    if (payload > HEAP_BLOCK_MAX_SIZE - 1) {
+        payload = (HEAP_BLOCK_MAX_SIZE - 1) & ~(ALIGN_SIZE - 1);
+    }
+
+    heap_block_t *block = (heap_block_t *)base;
+    block->prev_phys = NULL;
+    block->size = payload | HEAP_BLOCK_FREE;
+
+    heap_block_t *sentinel = block_next(block);
+    sentinel->prev_phys = block;
+    sentinel->size = 0;
+
+    insert_free_block(block);
+}
+
 /* Initialize heap allocator */
 void heap_init(void)
 {
-    heap_head = (heap_block_t *)&_heap_start;
-    heap_size = (uint32_t)&_heap_end - (uint32_t)&_heap_start;
-    heap_used = HEAP_BLOCK_HEADER_SIZE;
-
-    /* Initialize first free block */
-    heap_head->size = heap_size - HEAP_BLOCK_HEADER_SIZE;
-    heap_head->is_free = true;
-    heap_head->next = NULL;
+    heap_init_region(&_heap_start, (uint8_t *)&_heap_end - (uint8_t *)&_heap_start);
 
-    uart_printf("[HEAP] Initialized: %d bytes available\n", heap_head->size);
+    uart_printf("[HEAP] Initialized: %d bytes available\n", heap_free_bytes);
 }
 
 /* Allocate memory from heap */
@@ -50,41 +253,45 @@ void *kmalloc(size_t size)
     }
 
     size = align_size(size);
+    if (size < HEAP_BLOCK_MIN_SIZE) {
+        size = HEAP_BLOCK_MIN_SIZE;
+    }
 
-    heap_block_t *current = heap_head;
-    heap_block_t *prev = NULL;
+    int fl = 0, sl = 0;
+    heap_block_t *block = NULL;
+    uint32_t ps = spin_lock_irqsave(&heap_lock);
 
-    /* Find first fit free block */
-    while (current != NULL) {
-        if (current->is_free && current->size >= size) {
-            /* Found a suitable block */
+    if (size < HEAP_BLOCK_MAX_SIZE) {
+        mapping_search(size, &fl, &sl);
+        block = find_suitable_block(&fl, &sl);
+    }
 
-            /* If block is large enough, split it */
-            if (current->size >= size + HEAP_BLOCK_HEADER_SIZE + ALIGN_SIZE) {
-                /* Create new free block for remaining space */
-                heap_block_t *new_block = (heap_block_t *)((uint32_t)current + HEAP_BLOCK_HEADER_SIZE + size);
-                new_block->size = current->size - size - HEAP_BLOCK_HEADER_SIZE;
-                new_block->is_free = true;
-                new_block->next = current->next;
+    if (!block) {
+        spin_unlock_irqrestore(&heap_lock, ps);
+        LOG_ERROR("[HEAP] ERROR: Out of memory (requested: %d bytes)\n", size);
+        return NULL;
+    }
 
-                current->size = size;
-                current->next = new_block;
-            }
+    remove_free_block(block, fl, sl);
 
-            current->is_free = false;
-            heap_used += current->size + HEAP_BLOCK_HEADER_SIZE;
+    /* Split off the tail if it can hold a block of its own */
+    if (block_size(block) >= size + HEAP_BLOCK_HEADER_SIZE + HEAP_BLOCK_MIN_SIZE) {
+        heap_block_t *next = block_next(block);
+        heap_block_t *remaining = (heap_block_t *)((uint8_t *)block_to_ptr(block) + size);
 
-            /* Return pointer to data (after header) */
-            return (void *)((uint32_t)current + HEAP_BLOCK_HEADER_SIZE);
-        }
+        remaining->prev_phys = block;
+        remaining->size = (block_size(block) - size - HEAP_BLOCK_HEADER_SIZE) | HEAP_BLOCK_FREE;
+        next->prev_phys = remaining;
 
-        prev = current;
-        current = current->next;
+        block->size = size;
+        insert_free_block(remaining);
     }
 
-    /* No suitable block found */
-    uart_printf("[HEAP] ERROR: Out of memory (requested: %d bytes)\n", size);
-    return NULL;
+    block->size &= ~HEAP_BLOCK_FREE;
+    spin_unlock_irqrestore(&heap_lock, ps);
+
+    TRACE(TRACE_HEAP_ALLOC, block_size(block));
+    return block_to_ptr(block);
 }
 
 /* Free memory back to heap */
@@ -95,33 +302,43 @@ void kfree(void *ptr)
     }
 
     /* Get block header */
-    heap_block_t *block = (heap_block_t *)((uint32_t)ptr - HEAP_BLOCK_HEADER_SIZE);
+    heap_block_t *block = block_from_ptr(ptr);
+    uint32_t ps = spin_lock_irqsave(&heap_lock);
 
-    if (block->is_free) {
-        uart_puts("[HEAP] WARNING: Double free detected\n");
+    if (block_is_free(block)) {
+        spin_unlock_irqrestore(&heap_lock, ps);
+        LOG_WARN("[HEAP] WARNING: Double free detected\n");
         return;
     }
 
-    block->is_free = true;
-    heap_used -= block->size + HEAP_BLOCK_HEADER_SIZE;
+    TRACE(TRACE_HEAP_FREE, block_size(block));
 
-    /* Coalesce adjacent free blocks */
-    heap_block_t *current = heap_head;
-    while (current != NULL && current->next != NULL) {
-        if (current->is_free && current->next->is_free) {
-            /* Merge with next block */
-            current->size += current->next->size + HEAP_BLOCK_HEADER_SIZE;
-            current->next = current->next->next;
-        } else {
-            current = current->next;
-        }
+    /* Coalesce with the previous block */
+    heap_block_t *prev = block->prev_phys;
+    if (prev && block_is_free(prev)) {
+        unlink_free_block(prev);
+        prev->size += HEAP_BLOCK_HEADER_SIZE + block_size(block);
+        block = prev;
+        block_next(block)->prev_phys = block;
     }
+
+    /* Coalesce with the next block (the sentinel is never free) */
+    heap_block_t *next = block_next(block);
+    if (block_is_free(next)) {
+        unlink_free_block(next);
+        block->size += HEAP_BLOCK_HEADER_SIZE + block_size(next);
+        block_next(block)->prev_phys = block;
+    }
+
+    block->size |= HEAP_BLOCK_FREE;
+    insert_free_block(block);
+    spin_unlock_irqrestore(&heap_lock, ps);
 }
 
 /* Get heap statistics */
 void heap_stats(uint32_t *total, uint32_t *used, uint32_t *free)
 {
     if (total) *total = heap_size;
-    if (used) *used = heap_used;
-    if (free) *free = heap_size - heap_used;
+    if (used) *used = heap_size - heap_free_bytes;
+    if (free) *free = heap_free_bytes;
 }
@@ -1,8 +1,18 @@
 #include "interrupt.h"
+#include "esp32_defs.h"
+#include "xtensa.h"
 #include "uart.h"
+#include "log.h"
+#include "trace.h"
+#include "task.h"
+#include "kprintf.h"
+#include "config.h"
 
 #define MAX_INTERRUPTS  32
 
+/* Rescans of the pending bits per vector entry, so a source that never clears can't pin the core */
+#define INTERRUPT_MAX_PASSES  8
+
 /* Interrupt handler table */
 typedef struct {
     interrupt_handler_t handler;
@@ -11,6 +21,22 @@ typedef struct {
 
 static interrupt_entry_t interrupt_table[MAX_INTERRUPTS];
 
+/* Dispatch statistics, per core so handlers on both cores don't share counters */
+static interrupt_stats_t interrupt_stats_table[CONFIG_NUM_CORES][MAX_INTERRUPTS];
+
+/* Pending interrupts of each level with a C handler (index = level) */
+static const uint32_t interrupt_level_mask[] = {
+    0, XT_LEVEL1_INT_MASK, XT_LEVEL2_INT_MASK, XT_LEVEL3_INT_MASK
+};
+
+/* Highest set bit with the Xtensa NSAU instruction (value must be nonzero) */
+static inline uint32_t interrupt_top_bit(uint32_t value)
+{
+    uint32_t result;
+    __asm__ ("nsau %0, %1" : "=a" (result) : "a" (value));
+    return 31 - result;
+}
+
 /* Initialize interrupt system */
 void interrupt_init(void)
 {
@@ -23,36 +49,30 @@ void interrupt_init(void)
     uart_puts("[INT] Interrupt system initialized\n");
 }
 
-/* Enable interrupts globally */
-void interrupt_enable(void)
+/* Mask interrupts on this core, returns the PS to restore */
+uint32_t interrupt_disable(void)
 {
-    __asm__ volatile (
-        "rsil a2, 0\n"  /* Set interrupt level to 0 (enable all) */
-        : : : "a2"
-    );
+    return xt_irq_save();
 }
 
-/* Disable interrupts globally */
-void interrupt_disable(void)
+/* Restore the PS returned by interrupt_disable() */
+void interrupt_restore(uint32_t ps)
 {
-    __asm__ volatile (
-        "rsil a2, 15\n"  /* Set interrupt level to 15 (disable all) */
-        : : : "a2"
-    );
+    xt_irq_restore(ps);
 }
 
 /* Register an interrupt handler */
 void interrupt_register_handler(uint32_t int_num, interrupt_handler_t handler, void *arg)
 {
     if (int_num >= MAX_INTERRUPTS) {
-        uart_puts("[INT] ERROR: Invalid interrupt number\n");
+        LOG_ERROR("[INT] ERROR: Invalid interrupt number\n");
         return;
     }
 
     interrupt_table[int_num].handler = handler;
     interrupt_table[int_num].arg = arg;
 
-    uart_printf("[INT] Registered handler for interrupt %d\n", int_num);
+    LOG_INFO("[INT] Registered handler for interrupt %d\n", int_num);
 }
 
 /* Unregister an interrupt handler */
@@ -66,12 +86,131 @@ void interrupt_unregister_handler(uint32_t int_num)
     interrupt_table[int_num].arg = NULL;
 }
 
+/* Enable a CPU interrupt source */
+void interrupt_enable_source(uint32_t int_num)
+{
+    if (int_num >= MAX_INTERRUPTS) {
+        return;
+    }
+
+    /* Masked: a level-2/3 handler may change INTENABLE between the read and write */
+    uint32_t ps = xt_irq_save();
+    xt_set_intenable(xt_get_intenable() | BIT(int_num));
+    xt_irq_restore(ps);
+}
+
+/* Disable a CPU interrupt source */
+void interrupt_disable_source(uint32_t int_num)
+{
+    if (int_num >= MAX_INTERRUPTS) {
+        return;
+    }
+
+    /* Masked: a level-2/3 handler may change INTENABLE between the read and write */
+    uint32_t ps = xt_irq_save();
+    xt_set_intenable(xt_get_intenable() & ~BIT(int_num));
+    xt_irq_restore(ps);
+}
+
 /* Common interrupt dispatcher (called from assembly) */
 void interrupt_dispatch(uint32_t int_num)
 {
     if (int_num < MAX_INTERRUPTS && interrupt_table[int_num].handler) {
+        uint32_t start = CONFIG_IRQ_STATS ? xt_get_ccount() : 0;
+
+        TRACE(TRACE_ISR_ENTER, int_num);
         interrupt_table[int_num].handler(interrupt_table[int_num].arg);
-    } else {
-        uart_printf("[INT] Unhandled interrupt: %d\n", int_num);
+        TRACE(TRACE_ISR_EXIT, int_num);
+
+        if (CONFIG_IRQ_STATS) {
+            /* Per core, and each interrupt has one level, so updates never nest */
+            interrupt_stats_t *stats = &interrupt_stats_table[xt_core_id()][int_num];
+            uint32_t cycles = xt_get_ccount() - start;
+
+            stats->count++;
+            stats->cycles_total += cycles;
+            if (cycles > stats->cycles_max) {
+                stats->cycles_max = cycles;
+            }
+        }
+    } else if (int_num < MAX_INTERRUPTS) {
+        /* Nothing will clear it: turn it off, or a level-triggered source fires forever */
+        interrupt_disable_source(int_num);
+        xt_set_intclear(BIT(int_num));
+        LOG_WARN("[INT] Unhandled interrupt %d, source disabled\n", int_num);
+    }
+}
+
+/*
+ * Dispatch every pending interrupt of a level. Each pass takes the
+ * highest pending bit with NSAU instead of testing all 32, and sources
+ * raised while handlers ran are served before returning to the vector,
+ * up to INTERRUPT_MAX_PASSES passes. Anything still pending then is
+ * taken again once the vector has returned.
+ */
+void interrupt_level_dispatch(uint32_t level)
+{
+    uint32_t mask = interrupt_level_mask[level];
+
+    for (uint32_t pass = 0; pass < INTERRUPT_MAX_PASSES; pass++) {
+        uint32_t pending = xt_get_interrupt() & xt_get_intenable() & mask;
+        if (!pending) {
+            break;
+        }
+
+        do {
+            uint32_t int_num = interrupt_top_bit(pending);
+            pending &= ~BIT(int_num);
+            interrupt_dispatch(int_num);
+        } while (pending);
+    }
+}
+
+/* Report an unhandled exception and halt */
+void interrupt_exception(uint32_t *frame)
+{
+    task_t *task = task_get_current_on(xt_core_id());
+    char line[128];
+
+    ksnprintf(line, sizeof(line),
+              "\n[EXC] ERROR: Exception %u at %08x (EXCVADDR %08x) on core %u, task '%s'\n",
+              frame[XT_STK_EXCCAUSE / 4], frame[XT_STK_PC / 4], frame[XT_STK_EXCVADDR / 4],
+              xt_core_id(), task ? task->name : "none");
+    uart_puts_polled(line);
+    while(1);
+}
+
+/* Sum an interrupt's statistics over both cores */
+void interrupt_stats(uint32_t int_num, interrupt_stats_t *stats)
+{
+    stats->count = 0;
+    stats->cycles_max = 0;
+    stats->cycles_total = 0;
+
+    if (int_num >= MAX_INTERRUPTS) {
+        return;
+    }
+
+    for (uint32_t core = 0; core < CONFIG_NUM_CORES; core++) {
+        const interrupt_stats_t *s = &interrupt_stats_table[core][int_num];
+
+        stats->count += s->count;
+        stats->cycles_total += s->cycles_total;
+        stats->cycles_max = MAX(stats->cycles_max, s->cycles_max);
+    }
+}
+
+/* Print the statistics of every interrupt that has run */
+void interrupt_dump_stats(void)
+{
+    for (uint32_t i = 0; i < MAX_INTERRUPTS; i++) {
+        interrupt_stats_t stats;
+
+        interrupt_stats(i, &stats);
+        if (!stats.count) {
+            continue;
+        }
+        uart_printf("[INT] %2u: %u runs, max %u avg %u cycles\n", i, stats.count,
+                    stats.cycles_max, (uint32_t)(stats.cycles_total / stats.count));
     }
 }
@@ -1,11 +1,25 @@
 #include "kernel.h"
 #include "task.h"
 #include "heap.h"
+#include "pool.h"
+#include "interrupt.h"
 #include "uart.h"
+#include "log.h"
+#include "workqueue.h"
+#include "timer.h"
 #include "gpio.h"
+#include "smp.h"
+#include "kprintf.h"
 
 /* Forward declarations for demo tasks */
 extern void demo_init_tasks(void);
+extern void bench_init_tasks(void);
+
+#if CONFIG_STATIC_TASKS
+/* Idle task TCBs and stacks, one per core */
+static task_t idle_tcb[CONFIG_NUM_CORES];
+static uint8_t idle_stack[CONFIG_NUM_CORES][TASK_STACK_SIZE] __attribute__((aligned(TASK_STACK_ALIGN)));
+#endif
 
 /* Idle task - runs when no other tasks are ready */
 void idle_task(void *arg)
@@ -13,8 +27,9 @@ void idle_task(void *arg)
     uart_puts("[IDLE] Idle task started\n");
 
     while (1) {
-        /* Just yield to other tasks */
-        task_yield();
+        /* Free exited tasks, then run ready tasks or halt until the next deadline */
+        task_reap();
+        scheduler_idle();
     }
 }
 
@@ -24,6 +39,11 @@ void kernel_main(void)
     uart_puts("\n[KERNEL] Kernel initialization started\n");
 
     /* Initialize subsystems */
+    uart_puts("[KERNEL] Initializing interrupts...\n");
+    interrupt_init();
+    uart_init_interrupts();
+    smp_init();
+
     uart_puts("[KERNEL] Initializing heap...\n");
     heap_init();
 
@@ -33,6 +53,15 @@ void kernel_main(void)
     uart_puts("[KERNEL] Initializing scheduler...\n");
     scheduler_init();
 
+    uart_puts("[KERNEL] Initializing logging...\n");
+    log_init();
+
+    uart_puts("[KERNEL] Initializing deferred work...\n");
+    workqueue_init();
+
+    uart_puts("[KERNEL] Initializing timers...\n");
+    timer_service_init();
+
     uart_puts("[KERNEL] Initializing GPIO...\n");
     gpio_init();
 
@@ -41,21 +70,37 @@ void kernel_main(void)
     heap_stats(&total, &used, &free);
     uart_printf("[KERNEL] Heap: %d bytes total, %d used, %d free\n", total, used, free);
 
-    /* Create idle task */
-    uart_puts("[KERNEL] Creating idle task...\n");
-    task_t *idle = task_create("idle", idle_task, NULL, TASK_STACK_SIZE);
-    if (!idle) {
-        uart_puts("[KERNEL] ERROR: Failed to create idle task\n");
-        while(1);
+    /* Create one idle task per core, pinned to it */
+    uart_puts("[KERNEL] Creating idle tasks...\n");
+    for (uint32_t core = 0; core < CONFIG_NUM_CORES; core++) {
+        char name[8];
+        ksnprintf(name, sizeof(name), "idle%u", core);
+
+#if CONFIG_STATIC_TASKS
+        task_t *idle = task_create_static(&idle_tcb[core], name, idle_task, NULL, idle_stack[core],
+                                          TASK_STACK_SIZE, TASK_PRIORITY_IDLE);
+#else
+        task_t *idle = task_create(name, idle_task, NULL, TASK_STACK_SIZE, TASK_PRIORITY_IDLE);
+#endif
+        if (!idle || !task_set_affinity(idle, core)) {
+            uart_puts("[KERNEL] ERROR: Failed to create idle task\n");
+            while(1);
+        }
     }
 
     /* Create demo tasks */
     uart_puts("[KERNEL] Creating demo tasks...\n");
     demo_init_tasks();
 
+    if (CONFIG_BENCHMARKS) {
+        uart_puts("[KERNEL] Creating benchmark task...\n");
+        bench_init_tasks();
+    }
+
     /* Print final heap statistics */
     heap_stats(&total, &used, &free);
     uart_printf("[KERNEL] Heap after task creation: %d bytes used, %d free\n", used, free);
+    pool_dump_stats();
 
     /* Start the scheduler (never returns) */
     uart_puts("[KERNEL] Starting scheduler...\n");
@@ -0,0 +1,381 @@
+#include "kprintf.h"
+
+/* Flags */
+#define FMT_LEFT        0x01    /* '-': pad on the right */
+#define FMT_ZERO        0x02    /* '0': pad numbers with zeros */
+#define FMT_PLUS        0x04    /* '+': always print a sign */
+#define FMT_SPACE       0x08    /* ' ': space in place of a plus sign */
+#define FMT_ALT         0x10    /* '#': 0x / 0 prefix */
+
+/* Length modifiers */
+#define LEN_CHAR        1
+#define LEN_SHORT       2
+#define LEN_LLONG       3
+
+/* Large enough for a 64-bit value in octal */
+#define FMT_NUM_BUF     24
+
+static const char fmt_spaces[] = "                ";
+static const char fmt_zeros[] = "0000000000000000";
+
+/* Output state shared by the helpers */
+typedef struct {
+    kfmt_out_t out;
+    void *ctx;
+    int count;
+} fmt_state_t;
+
+static void fmt_emit(fmt_state_t *st, const char *data, size_t len)
+{
+    if (len > 0) {
+        st->out(st->ctx, data, len);
+        st->count += len;
+    }
+}
+
+/* Emit len copies of a space or zero, in chunks */
+static void fmt_pad(fmt_state_t *st, const char *fill, int len)
+{
+    while (len > 0) {
+        int chunk = MIN(len, (int)sizeof(fmt_spaces) - 1);
+        fmt_emit(st, fill, chunk);
+        len -= chunk;
+    }
+}
+
+/*
+ * Decimal digits of a 32-bit value, written backwards ending at end.
+ * Dividing by ten is a multiply by its fixed-point reciprocal
+ * (0xCCCCCCCD / 2^35), which is exact for every 32-bit input.
+ */
+static char *fmt_dec32(char *end, uint32_t value)
+{
+    do {
+        uint32_t q = (uint32_t)(((uint64_t)value * 0xCCCCCCCDU) >> 35);
+        *--end = '0' + (value - q * 10);
+        value = q;
+    } while (value);
+    return end;
+}
+
+/* Decimal digits of a 64-bit value: above 32 bits, subtract powers of ten */
+static char *fmt_dec64(char *end, uint64_t value)
+{
+    static const uint64_t pow10[] = {
+        10000000000000000000ULL, 1000000000000000000ULL, 100000000000000000ULL,
+        10000000000000000ULL, 1000000000000000ULL, 100000000000000ULL,
+        10000000000000ULL, 1000000000000ULL, 100000000000ULL, 10000000000ULL,
+        1000000000ULL
+    };
+    char digits[ARRAY_SIZE(pow10)];
+    int n = 0;
+    bool started = false;
+
+    if (value <= 0xFFFFFFFFULL) {
+        return fmt_dec32(end, (uint32_t)value);
+    }
+
+    /* Peel off everything above the low nine digits */
+    for (size_t i = 0; i < ARRAY_SIZE(pow10); i++) {
+        char digit = '0';
+        while (value >= pow10[i]) {
+            value -= pow10[i];
+            digit++;
+        }
+        if (digit != '0' || started) {
+            digits[n++] = digit;
+            started = true;
+        }
+    }
+
+    /* value < 10^9 now: the low nine digits, zero-filled */
+    char *start = fmt_dec32(end, (uint32_t)value);
+    while (end - start < 9) {
+        *--start = '0';
+    }
+    while (n > 0) {
+        *--start = digits[--n];
+    }
+    return start;
+}
+
+/* Digits in a power-of-two base, written backwards ending at end */
+static char *fmt_pow2(char *end, uint64_t value, int shift, bool upper)
+{
+    const char *hex = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    uint32_t mask = (1U << shift) - 1;
+    uint32_t low = (uint32_t)value;
+    uint32_t high = (uint32_t)(value >> 32);
+
+    /* Stay in 32 bits when possible; 64-bit shifts are library calls */
+    if (!high) {
+        do {
+            *--end = hex[low & mask];
+            low >>= shift;
+        } while (low);
+        return end;
+    }
+
+    do {
+        *--end = hex[(uint32_t)value & mask];
+        value >>= shift;
+    } while (value);
+    return end;
+}
+
+/* Emit a converted number with sign, prefix, precision and width */
+static void fmt_number(fmt_state_t *st, const char *digits, int ndigits,
+                       const char *prefix, int flags, int width, int precision)
+{
+    int nprefix = 0;
+    while (prefix[nprefix]) {
+        nprefix++;
+    }
+
+    /* An explicit precision disables zero padding */
+    int zeros = (precision > ndigits) ? precision - ndigits : 0;
+    int len = nprefix + zeros + ndigits;
+    int pad = (width > len) ? width - len : 0;
+
+    if ((flags & FMT_ZERO) && !(flags & FMT_LEFT) && precision < 0) {
+        zeros += pad;
+        pad = 0;
+    }
+
+    if (!(flags & FMT_LEFT)) {
+        fmt_pad(st, fmt_spaces, pad);
+    }
+    fmt_emit(st, prefix, nprefix);
+    fmt_pad(st, fmt_zeros, zeros);
+    fmt_emit(st, digits, ndigits);
+    if (flags & FMT_LEFT) {
+        fmt_pad(st, fmt_spaces, pad);
+    }
+}
+
+/* Emit a string or character field */
+static void fmt_string(fmt_state_t *st, const char *str, int len, int flags, int width)
+{
+    int pad = (width > len) ? width - len : 0;
+
+    if (!(flags & FMT_LEFT)) {
+        fmt_pad(st, fmt_spaces, pad);
+    }
+    fmt_emit(st, str, len);
+    if (flags & FMT_LEFT) {
+        fmt_pad(st, fmt_spaces, pad);
+    }
+}
+
+/* Format to a sink */
+int kvformat(kfmt_out_t out, void *ctx, const char *fmt, va_list args)
+{
+    fmt_state_t st = { out, ctx, 0 };
+    char buf[FMT_NUM_BUF];
+    char *end = buf + sizeof(buf);
+
+    while (*fmt) {
+        /* Literal text up to the next conversion goes out in one chunk */
+        const char *run = fmt;
+        while (*fmt && *fmt != '%') {
+            fmt++;
+        }
+        fmt_emit(&st, run, fmt - run);
+        if (!*fmt) {
+            break;
+        }
+        fmt++;
+
+        /* Flags */
+        int flags = 0;
+        for (;; fmt++) {
+            if (*fmt == '-') flags |= FMT_LEFT;
+            else if (*fmt == '0') flags |= FMT_ZERO;
+            else if (*fmt == '+') flags |= FMT_PLUS;
+            else if (*fmt == ' ') flags |= FMT_SPACE;
+            else if (*fmt == '#') flags |= FMT_ALT;
+            else break;
+        }
+
+        /* Width */
+        int width = 0;
+        if (*fmt == '*') {
+            width = va_arg(args, int);
+            if (width < 0) {
+                flags |= FMT_LEFT;
+                width = -width;
+            }
+            fmt++;
+        } else {
+            while (*fmt >= '0' && *fmt <= '9') {
+                width = width * 10 + (*fmt++ - '0');
+            }
+        }
+
+        /* Precision */
+        int precision = -1;
+        if (*fmt == '.') {
+            fmt++;
+            precision = 0;
+            if (*fmt == '*') {
+                precision = va_arg(args, int);
+                fmt++;
+            } else {
+                while (*fmt >= '0' && *fmt <= '9') {
+                    precision = precision * 10 + (*fmt++ - '0');
+                }
+            }
+        }
+
+        /* Length modifier (long and size_t are the same size as int) */
+        int length = 0;
+        if (*fmt == 'h') {
+            length = (fmt[1] == 'h') ? LEN_CHAR : LEN_SHORT;
+        } else if (*fmt == 'l' && fmt[1] == 'l') {
+            length = LEN_LLONG;
+        }
+        while (*fmt == 'h' || *fmt == 'l' || *fmt == 'z') {
+            fmt++;
+        }
+
+        uint64_t value;
+        const char *prefix = "";
+        char *digits;
+        char conv = *fmt;
+
+        switch (conv) {
+        case 'd':
+        case 'i': {
+            int64_t sval = (length == LEN_LLONG) ? va_arg(args, long long) : va_arg(args, int);
+            if (length == LEN_CHAR) {
+                sval = (signed char)sval;
+            } else if (length == LEN_SHORT) {
+                sval = (short)sval;
+            }
+            if (sval < 0) {
+                prefix = "-";
+                value = -(uint64_t)sval;
+            } else {
+                prefix = (flags & FMT_PLUS) ? "+" : (flags & FMT_SPACE) ? " " : "";
+                value = sval;
+            }
+            digits = (precision == 0 && value == 0) ? end : fmt_dec64(end, value);
+            fmt_number(&st, digits, end - digits, prefix, flags, width, precision);
+            break;
+        }
+
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'o':
+            value = (length == LEN_LLONG) ? va_arg(args, unsigned long long)
+                                          : va_arg(args, unsigned int);
+            if (length == LEN_CHAR) {
+                value = (uint8_t)value;
+            } else if (length == LEN_SHORT) {
+                value = (uint16_t)value;
+            }
+            if (precision == 0 && value == 0) {
+                digits = end;
+            } else if (conv == 'u') {
+                digits = fmt_dec64(end, value);
+            } else if (conv == 'o') {
+                digits = fmt_pow2(end, value, 3, false);
+            } else {
+                digits = fmt_pow2(end, value, 4, conv == 'X');
+                if ((flags & FMT_ALT) && value) {
+                    prefix = (conv == 'X') ? "0X" : "0x";
+                }
+            }
+            /* '#' octal starts with a 0, even for an empty conversion, unless the precision pads one */
+            if (conv == 'o' && (flags & FMT_ALT) && precision <= end - digits &&
+                (digits == end || *digits != '0')) {
+                prefix = "0";
+            }
+            fmt_number(&st, digits, end - digits, prefix, flags, width, precision);
+            break;
+
+        case 'p':
+            value = (uintptr_t)va_arg(args, void *);
+            digits = fmt_pow2(end, value, 4, false);
+            fmt_number(&st, digits, end - digits, "0x", flags & ~FMT_ZERO,
+                       width, 2 * sizeof(void *));
+            break;
+
+        case 'c':
+            buf[0] = (char)va_arg(args, int);
+            fmt_string(&st, buf, 1, flags, width);
+            break;
+
+        case 's': {
+            const char *str = va_arg(args, const char *);
+            int len = 0;
+            if (!str) {
+                str = "(null)";
+            }
+            while (str[len] && (precision < 0 || len < precision)) {
+                len++;
+            }
+            fmt_string(&st, str, len, flags, width);
+            break;
+        }
+
+        case '%':
+            fmt_emit(&st, "%", 1);
+            break;
+
+        case '\0':
+            /* Trailing '%' */
+            return st.count;
+
+        default:
+            /* Unknown conversion: print it as-is */
+            fmt_emit(&st, "%", 1);
+            fmt_emit(&st, fmt, 1);
+            break;
+        }
+        fmt++;
+    }
+
+    return st.count;
+}
+
+/* Buffer sink for kvsnprintf */
+typedef struct {
+    char *buf;
+    size_t size;
+    size_t len;
+} fmt_buffer_t;
+
+static void fmt_buffer_out(void *ctx, const char *data, size_t len)
+{
+    fmt_buffer_t *b = (fmt_buffer_t *)ctx;
+
+    for (size_t i = 0; i < len && b->len + 1 < b->size; i++) {
+        b->buf[b->len++] = data[i];
+    }
+}
+
+/* Format into a caller buffer */
+int kvsnprintf(char *buf, size_t size, const char *fmt, va_list args)
+{
+    fmt_buffer_t b = { buf, size, 0 };
+    int count = kvformat(fmt_buffer_out, &b, fmt, args);
+
+    if (size > 0) {
+        buf[b.len] = '\0';
+    }
+    return count;
+}
+
+/* Format into a caller buffer */
+int ksnprintf(char *buf, size_t size, const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    int count = kvsnprintf(buf, size, fmt, args);
+    va_end(args);
+
+    return count;
+}
@@ -0,0 +1,263 @@
+#include "log.h"
+#include "task.h"
+#include "uart.h"
+#include "xtensa.h"
+
+/*
+ * Deferred log ring.
+ *
+ * Any number of tasks and interrupt handlers reserve space by advancing
+ * log_head with compare-and-swap, fill in their record and publish it
+ * by writing the header last. The log task is the only consumer: it
+ * sends each published record, clears it and advances log_tail. Records
+ * never wrap; a PAD record fills the end of the ring instead.
+ */
+
+#define LOG_BUFFER_MASK     (LOG_BUFFER_WORDS - 1)
+#define LOG_RECORD_FIXED    3       /* Header, format ID, timestamp */
+#define LOG_RECORD_MAX      (LOG_RECORD_FIXED + LOG_MAX_ARGS * (1 + LOG_STRING_MAX / 4))
+
+static uint32_t log_buffer[LOG_BUFFER_WORDS];
+static uint32_t log_head = 0;               /* Next word to reserve */
+static volatile uint32_t log_tail = 0;      /* Oldest unsent word */
+static uint32_t log_dropped_count = 0;
+
+#if CONFIG_LOG_DEFERRED
+static uint32_t log_dropped_sent = 0;
+static task_t *log_task = NULL;
+static volatile bool log_task_idle = false;
+#endif
+
+/* Reserve words in the ring; returns false if the ring is full */
+static bool log_reserve(uint32_t words, uint32_t *start)
+{
+    uint32_t head = __atomic_load_n(&log_head, __ATOMIC_RELAXED);
+    uint32_t pad;
+
+    do {
+        uint32_t offset = head & LOG_BUFFER_MASK;
+
+        pad = (offset + words > LOG_BUFFER_WORDS) ? LOG_BUFFER_WORDS - offset : 0;
+        if (head + pad + words - log_tail > LOG_BUFFER_WORDS) {
+            return false;
+        }
+    } while (!__atomic_compare_exchange_n(&log_head, &head, head + pad + words, true,
+                                          __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+
+    if (pad) {
+        __atomic_store_n(&log_buffer[head & LOG_BUFFER_MASK],
+                         LOG_HDR_VALID | LOG_HDR_PAD | pad, __ATOMIC_RELEASE);
+    }
+
+    *start = head + pad;
+    return true;
+}
+
+/* Length of a string argument's copy, including the NUL */
+static uint32_t log_string_len(const char *str)
+{
+    uint32_t len = 0;
+
+    if (!str) {
+        return 1;
+    }
+    while (len < LOG_STRING_MAX - 1 && str[len]) {
+        len++;
+    }
+    return len + 1;
+}
+
+/* Queue one record */
+void log_write(uint32_t level, uint32_t fmt_id, const uint32_t *args,
+               uint32_t nargs, uint32_t str_mask)
+{
+    uint32_t lens[LOG_MAX_ARGS];
+    uint32_t words = LOG_RECORD_FIXED + nargs;
+
+    for (uint32_t i = 0; i < nargs; i++) {
+        if (str_mask & BIT(i)) {
+            lens[i] = log_string_len((const char *)(uintptr_t)args[i]);
+            words += (lens[i] + 3) / 4;
+        }
+    }
+
+    uint32_t start;
+    if (!log_reserve(words, &start)) {
+        __atomic_fetch_add(&log_dropped_count, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    uint32_t *record = &log_buffer[start & LOG_BUFFER_MASK];
+    uint32_t *strings = &record[LOG_RECORD_FIXED + nargs];
+
+    record[1] = fmt_id;
+    record[2] = xt_get_ccount();
+
+    for (uint32_t i = 0; i < nargs; i++) {
+        if (str_mask & BIT(i)) {
+            const char *str = (const char *)(uintptr_t)args[i];
+            uint8_t *dst = (uint8_t *)strings;
+            uint32_t len = lens[i];
+
+            for (uint32_t j = 0; j < len - 1; j++) {
+                dst[j] = str[j];
+            }
+            for (uint32_t j = len - 1; j < ALIGN_UP(len, 4); j++) {
+                dst[j] = '\0';
+            }
+
+            record[LOG_RECORD_FIXED + i] = len;
+            strings += (len + 3) / 4;
+        } else {
+            record[LOG_RECORD_FIXED + i] = args[i];
+        }
+    }
+
+    /* Publish */
+    __atomic_store_n(&record[0], LOG_HDR_VALID |
+                     ((level & LOG_HDR_LEVEL) << LOG_HDR_LEVEL_S) |
+                     (nargs << LOG_HDR_NARGS_S) |
+                     ((str_mask & LOG_HDR_STRMASK) << LOG_HDR_STRMASK_S) |
+                     words, __ATOMIC_RELEASE);
+
+#if CONFIG_LOG_DEFERRED
+    /* Pairs with the fence in the log task: either it sees the record or we see it idle */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (log_task_idle) {
+        log_task_idle = false;
+        task_wake(log_task);
+    }
+#endif
+}
+
+/* Number of messages lost because the ring was full */
+uint32_t log_dropped(void)
+{
+    return log_dropped_count;
+}
+
+#if CONFIG_LOG_DEFERRED
+
+/* Send bytes to the UART, sleeping while its TX buffer is full */
+static void log_send(const void *data, size_t len)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+
+    while (len > 0) {
+        size_t sent = uart_write(bytes, len);
+        bytes += sent;
+        len -= sent;
+        if (len > 0) {
+            task_sleep_ms(1);
+        }
+    }
+}
+
+/* Send one record as a wire frame */
+static void log_send_record(const uint32_t *record, uint32_t words)
+{
+    uint8_t frame[3 + 4 * LOG_RECORD_MAX];
+    uint8_t *p = frame;
+
+    *p++ = LOG_FRAME_SYNC;
+    *p++ = LOG_FRAME_TAG;
+    *p++ = (uint8_t)words;
+
+    for (uint32_t i = 0; i < words; i++) {
+        uint32_t word = record[i];
+        *p++ = word & 0xFF;
+        *p++ = (word >> 8) & 0xFF;
+        *p++ = (word >> 16) & 0xFF;
+        *p++ = (word >> 24) & 0xFF;
+    }
+
+    log_send(frame, p - frame);
+}
+
+/* Send every published record; returns false if the ring was empty */
+static bool log_drain(void)
+{
+    bool sent = false;
+
+    while (1) {
+        uint32_t tail = log_tail;
+        uint32_t *record = &log_buffer[tail & LOG_BUFFER_MASK];
+        uint32_t header = __atomic_load_n(&record[0], __ATOMIC_ACQUIRE);
+
+        if (!(header & LOG_HDR_VALID)) {
+            break;
+        }
+
+        uint32_t words = header & LOG_HDR_WORDS;
+        if (!(header & LOG_HDR_PAD)) {
+            log_send_record(record, words);
+            sent = true;
+        }
+
+        /* Clear the whole record so no stale header is seen after wrapping */
+        for (uint32_t i = 0; i < words; i++) {
+            record[i] = 0;
+        }
+        __atomic_store_n(&log_tail, tail + words, __ATOMIC_RELEASE);
+    }
+
+    /* Report losses once there is room again */
+    uint32_t dropped = log_dropped_count;
+    if (dropped != log_dropped_sent) {
+        uint32_t record[LOG_RECORD_FIXED + 1] = {
+            LOG_HDR_VALID | (LOG_LEVEL_WARN << LOG_HDR_LEVEL_S) |
+                (1 << LOG_HDR_NARGS_S) | (LOG_RECORD_FIXED + 1),
+            LOG_FMT_DROPPED,
+            xt_get_ccount(),
+            dropped - log_dropped_sent
+        };
+        log_send_record(record, LOG_RECORD_FIXED + 1);
+        log_dropped_sent = dropped;
+        sent = true;
+    }
+
+    return sent;
+}
+
+/* Log task: send records as they are published, otherwise stay blocked */
+static void log_task_entry(void *arg)
+{
+    while (1) {
+        if (log_drain()) {
+            continue;
+        }
+
+        /*
+         * Recheck with interrupts masked so a wakeup can't be missed. A
+         * producer on the other core may wake us before we block; that
+         * wakeup is kept and task_block() returns at once.
+         */
+        uint32_t ps = xt_irq_save();
+        log_task_idle = true;
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        uint32_t header = __atomic_load_n(&log_buffer[log_tail & LOG_BUFFER_MASK], __ATOMIC_ACQUIRE);
+        if (!(header & LOG_HDR_VALID)) {
+            task_block();
+        }
+        log_task_idle = false;
+        xt_irq_restore(ps);
+    }
+}
+
+#endif /* CONFIG_LOG_DEFERRED */
+
+/* Initialize logging and start the log task */
+void log_init(void)
+{
+#if CONFIG_LOG_DEFERRED
+    log_task = TASK_CREATE_BOOT("log", log_task_entry, NULL, TASK_STACK_SIZE, TASK_PRIORITY_LOW);
+    if (!log_task) {
+        uart_puts("[LOG] ERROR: Failed to create log task\n");
+        return;
+    }
+    uart_printf("[LOG] Deferred logging enabled (level %d, %d word ring)\n",
+                CONFIG_LOG_LEVEL, LOG_BUFFER_WORDS);
+#else
+    uart_printf("[LOG] Logging to UART (level %d)\n", CONFIG_LOG_LEVEL);
+#endif
+}
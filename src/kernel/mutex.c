@@ -0,0 +1,215 @@
+#include "mutex.h"
+#include "kernel.h"
+#include "uart.h"
+#include "log.h"
+#include "xtensa.h"
+
+/*
+ * Mutexes keep their state under scheduler_lock, so queueing a waiter,
+ * boosting the owner and blocking happen without a window for unlock.
+ */
+
+/* Longest chain of owners a priority change is passed along (stops lock cycles) */
+#define MUTEX_CHAIN_MAX  16
+
+/* All mutexes, for statistics */
+static mutex_t *mutex_list = NULL;
+
+/* Make task the owner (scheduler_lock held) */
+static void mutex_take(mutex_t *mutex, task_t *task)
+{
+    mutex->owner = task;
+    mutex->held_next = task->held_mutexes;
+    task->held_mutexes = mutex;
+
+    if (CONFIG_LOCK_STATS) {
+        mutex->stats.locks++;
+        mutex->hold_start = xt_get_ccount();
+    }
+}
+
+/* Take the mutex off its owner's held list (scheduler_lock held) */
+static void mutex_release(mutex_t *mutex)
+{
+    task_t *owner = mutex->owner;
+
+    for (mutex_t **link = &owner->held_mutexes; *link; link = &(*link)->held_next) {
+        if (*link == mutex) {
+            *link = mutex->held_next;
+            break;
+        }
+    }
+    mutex->held_next = NULL;
+    mutex->owner = NULL;
+
+    if (CONFIG_LOCK_STATS) {
+        uint32_t held = xt_get_ccount() - mutex->hold_start;
+        mutex->stats.hold_total += held;
+        if (held > mutex->stats.hold_max) {
+            mutex->stats.hold_max = held;
+        }
+    }
+}
+
+/* Initialize a mutex */
+void mutex_init(mutex_t *mutex, const char *name)
+{
+    mutex->name = name;
+    mutex->owner = NULL;
+    waitq_init(&mutex->waiters, WAITQ_PRIORITY);
+    mutex->held_next = NULL;
+    mutex->hold_start = 0;
+    mutex->stats.locks = 0;
+    mutex->stats.contended = 0;
+    mutex->stats.timeouts = 0;
+    mutex->stats.hold_max = 0;
+    mutex->stats.hold_total = 0;
+
+    uint32_t ps = spin_lock_irqsave(&scheduler_lock);
+    mutex->next = mutex_list;
+    mutex_list = mutex;
+    spin_unlock_irqrestore(&scheduler_lock, ps);
+}
+
+/* Recompute a task's priority and pass the change along its wait chain */
+void mutex_update_priority(task_t *task)
+{
+    for (uint32_t depth = 0; task && depth < MUTEX_CHAIN_MAX; depth++) {
+        uint32_t priority = task->base_priority;
+
+        for (mutex_t *held = task->held_mutexes; held; held = held->held_next) {
+            task_t *waiter = waitq_peek(&held->waiters);
+            if (waiter && waiter->priority > priority) {
+                priority = waiter->priority;
+            }
+        }
+
+        if (priority == task->priority) {
+            return;
+        }
+        task_set_priority_locked(task, priority);
+
+        mutex_t *mutex = task->blocked_on;
+        if (!mutex) {
+            return;
+        }
+
+        /* Keep the wait queue in priority order, then update its owner */
+        waitq_remove(&mutex->waiters, task);
+        waitq_insert(&mutex->waiters, task);
+        task = mutex->owner;
+    }
+}
+
+/* Take a mutex, waiting up to timeout_ms */
+bool mutex_lock(mutex_t *mutex, uint32_t timeout_ms)
+{
+    task_t *current = task_get_current();
+
+    /* Nothing to exclude before the scheduler starts */
+    if (!current) {
+        return true;
+    }
+
+    uint32_t ps = spin_lock_irqsave(&scheduler_lock);
+
+    if (!mutex->owner) {
+        mutex_take(mutex, current);
+        spin_unlock_irqrestore(&scheduler_lock, ps);
+        return true;
+    }
+
+    if (mutex->owner == current) {
+        spin_unlock_irqrestore(&scheduler_lock, ps);
+        LOG_ERROR("[MUTEX] ERROR: Task '%s' already holds mutex '%s'\n",
+                  current->name, mutex->name);
+        return false;
+    }
+
+    if (CONFIG_LOCK_STATS) {
+        mutex->stats.contended++;
+    }
+    if (timeout_ms == 0) {
+        spin_unlock_irqrestore(&scheduler_lock, ps);
+        return false;
+    }
+
+    /* Queue up and lend our priority to the owner */
+    current->blocked_on = mutex;
+    waitq_insert(&mutex->waiters, current);
+    mutex_update_priority(mutex->owner);
+
+    /* mutex_unlock hands the mutex over before waking us */
+    bool taken = waitq_block(&mutex->waiters, timeout_ms) != 0;
+    if (!taken) {
+        current->blocked_on = NULL;
+        mutex_update_priority(mutex->owner);
+        if (CONFIG_LOCK_STATS) {
+            mutex->stats.timeouts++;
+        }
+    }
+
+    spin_unlock_irqrestore(&scheduler_lock, ps);
+    return taken;
+}
+
+/* Take a mutex only if it is free */
+bool mutex_trylock(mutex_t *mutex)
+{
+    return mutex_lock(mutex, 0);
+}
+
+/* Release a mutex held by the current task */
+void mutex_unlock(mutex_t *mutex)
+{
+    task_t *current = task_get_current();
+
+    if (!current) {
+        return;
+    }
+
+    uint32_t ps = spin_lock_irqsave(&scheduler_lock);
+
+    if (mutex->owner != current) {
+        spin_unlock_irqrestore(&scheduler_lock, ps);
+        LOG_ERROR("[MUTEX] ERROR: Task '%s' doesn't hold mutex '%s'\n",
+                  current->name, mutex->name);
+        return;
+    }
+
+    mutex_release(mutex);
+
+    /* Hand over to the highest priority waiter, which inherits from those left */
+    task_t *next = waitq_peek(&mutex->waiters);
+    if (next) {
+        next->blocked_on = NULL;
+        waitq_wake(&mutex->waiters, next, 1);
+        mutex_take(mutex, next);
+        mutex_update_priority(next);
+    }
+
+    /* Drop any priority lent through this mutex, and yield if now outranked */
+    mutex_update_priority(current);
+    waitq_unlock(ps);
+}
+
+/* Copy a mutex's statistics */
+void mutex_stats(const mutex_t *mutex, mutex_stats_t *stats)
+{
+    uint32_t ps = spin_lock_irqsave(&scheduler_lock);
+    *stats = mutex->stats;
+    spin_unlock_irqrestore(&scheduler_lock, ps);
+}
+
+/* Print statistics of every mutex */
+void mutex_dump_stats(void)
+{
+    for (mutex_t *mutex = mutex_list; mutex; mutex = mutex->next) {
+        mutex_stats_t stats;
+
+        mutex_stats(mutex, &stats);
+        uart_printf("[MUTEX] %s: %u locks, %u contended, %u timeouts, hold max %u avg %u cycles\n",
+                    mutex->name, stats.locks, stats.contended, stats.timeouts, stats.hold_max,
+                    stats.locks ? (uint32_t)(stats.hold_total / stats.locks) : 0);
+    }
+}
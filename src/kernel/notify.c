@@ -0,0 +1,126 @@
+#include "task.h"
+#include "kernel.h"
+#include "waitq.h"
+#include "xtensa.h"
+
+/*
+ * Direct-to-task notifications.
+ *
+ * The notification word and state live in the TCB and are guarded by
+ * scheduler_lock, so a notify from an interrupt handler is one locked
+ * update plus, if the task is waiting, making it ready.
+ */
+
+/*
+ * Block the current task until it is notified or the deadline passes.
+ * Called and returns with scheduler_lock held. Returns false on timeout.
+ */
+static bool notify_block(task_t *current, uint32_t timeout_ms, uint32_t deadline)
+{
+    while (current->notify_state != TASK_NOTIFY_PENDING) {
+        bool woken = true;
+
+        current->notify_state = TASK_NOTIFY_WAITING;
+        if (timeout_ms == TASK_WAIT_FOREVER) {
+            task_block_locked();
+        } else {
+            woken = task_block_until_locked(deadline);
+        }
+        spin_lock(&scheduler_lock);
+
+        if (!woken) {
+            break;
+        }
+    }
+
+    return current->notify_state == TASK_NOTIFY_PENDING;
+}
+
+/* Update a task's notification word and wake it if it is waiting */
+void task_notify(task_t *task, uint32_t value, task_notify_action_t action)
+{
+    uint32_t ps = spin_lock_irqsave(&scheduler_lock);
+
+    switch (action) {
+    case TASK_NOTIFY_SET_BITS:
+        task->notify_value |= value;
+        break;
+    case TASK_NOTIFY_INCREMENT:
+        task->notify_value++;
+        break;
+    case TASK_NOTIFY_OVERWRITE:
+        task->notify_value = value;
+        break;
+    }
+
+    uint8_t state = task->notify_state;
+    task->notify_state = TASK_NOTIFY_PENDING;
+    if (state == TASK_NOTIFY_WAITING) {
+        task_wake_locked(task);
+    }
+
+    waitq_unlock(ps);
+}
+
+/* Wait for the notification word to be nonzero and take it */
+uint32_t task_notify_take(bool clear, uint32_t timeout_ms)
+{
+    uint32_t deadline = scheduler_get_ticks() + ms_to_ticks(timeout_ms) + 1;
+    uint32_t ps = spin_lock_irqsave(&scheduler_lock);
+    task_t *current = task_get_current_on(xt_core_id());
+
+    if (!current) {
+        spin_unlock_irqrestore(&scheduler_lock, ps);
+        return 0;
+    }
+
+    /* Notifications that left the word zero don't count */
+    while (current->notify_value == 0 && timeout_ms != 0) {
+        current->notify_state = TASK_NOTIFY_NONE;
+        if (!notify_block(current, timeout_ms, deadline)) {
+            break;
+        }
+    }
+
+    uint32_t value = current->notify_value;
+    if (value) {
+        current->notify_value = clear ? 0 : value - 1;
+    }
+    current->notify_state = TASK_NOTIFY_NONE;
+
+    spin_unlock_irqrestore(&scheduler_lock, ps);
+    return value;
+}
+
+/* Wait for a notification */
+bool task_notify_wait(uint32_t clear_on_entry, uint32_t clear_on_exit, uint32_t *value,
+                      uint32_t timeout_ms)
+{
+    uint32_t deadline = scheduler_get_ticks() + ms_to_ticks(timeout_ms) + 1;
+    uint32_t ps = spin_lock_irqsave(&scheduler_lock);
+    task_t *current = task_get_current_on(xt_core_id());
+
+    if (!current) {
+        spin_unlock_irqrestore(&scheduler_lock, ps);
+        return false;
+    }
+
+    bool notified = current->notify_state == TASK_NOTIFY_PENDING;
+    if (!notified) {
+        current->notify_value &= ~clear_on_entry;
+        if (timeout_ms != 0) {
+            notified = notify_block(current, timeout_ms, deadline);
+        }
+    }
+
+    if (value) {
+        *value = current->notify_value;
+    }
+    if (notified) {
+        current->notify_value &= ~clear_on_exit;
+    }
+    current->notify_state = TASK_NOTIFY_NONE;
+
+    spin_unlock_irqrestore(&scheduler_lock, ps);
+    return notified;
+}
@@ -0,0 +1,167 @@
+#include "pool.h"
+#include "heap.h"
+#include "uart.h"
+#include "log.h"
+
+/*
+ * Fixed-size object pools.
+ *
+ * Objects are laid out back to back in one contiguous region with a
+ * POOL_ALIGN stride, and free objects are chained through their first
+ * word, so alloc and free are a single list push or pop. With
+ * CONFIG_POOL_CHECK the second word of a free object holds
+ * POOL_FREE_MARK; a free of an object carrying it searches the free
+ * list, so only a real double free is rejected.
+ */
+
+/* Second word of a free object (CONFIG_POOL_CHECK) */
+#define POOL_FREE_MARK  0xF4EE0B1Cu
+
+/* All pools, for statistics */
+static pool_t *pool_list = NULL;
+
+static uint32_t pool_stride(size_t obj_size)
+{
+    if (obj_size < sizeof(void *)) {
+        obj_size = sizeof(void *);
+    }
+    return ALIGN_UP(obj_size, POOL_ALIGN);
+}
+
+/* Initialize a pool over caller-provided storage */
+void pool_init(pool_t *pool, const char *name, size_t obj_size, uint32_t count, void *storage)
+{
+    pool->name = name;
+    pool->storage = (uint8_t *)storage;
+    pool->obj_size = pool_stride(obj_size);
+    pool->capacity = count;
+    pool->used = 0;
+    pool->peak = 0;
+    pool->free_list = NULL;
+    spin_lock_init(&pool->lock);
+
+    /* Thread the free list so objects come out in address order */
+    for (uint32_t i = count; i > 0; i--) {
+        void **obj = (void **)(pool->storage + (i - 1) * pool->obj_size);
+        obj[0] = pool->free_list;
+        if (CONFIG_POOL_CHECK) {
+            obj[1] = (void *)POOL_FREE_MARK;
+        }
+        pool->free_list = obj;
+    }
+
+    pool->next = pool_list;
+    pool_list = pool;
+}
+
+/* Create a pool whose header and storage come from one heap allocation */
+pool_t *pool_create(const char *name, size_t obj_size, uint32_t count)
+{
+    uint32_t header = ALIGN_UP(sizeof(pool_t), POOL_ALIGN);
+    uint32_t stride = pool_stride(obj_size);
+
+    /* Over-allocate so the storage can start on a POOL_ALIGN boundary */
+    uint8_t *mem = (uint8_t *)kmalloc(header + stride * count + POOL_ALIGN);
+    if (!mem) {
+        LOG_ERROR("[POOL] ERROR: Failed to allocate pool '%s'\n", name);
+        return NULL;
+    }
+
+    pool_t *pool = (pool_t *)mem;
+    uint8_t *storage = (uint8_t *)ALIGN_UP((uintptr_t)mem + header, POOL_ALIGN);
+    pool_init(pool, name, obj_size, count, storage);
+
+    LOG_INFO("[POOL] Created pool '%s' (%d x %d bytes)\n", name, count, stride);
+
+    return pool;
+}
+
+/* Allocate one object */
+void *pool_alloc(pool_t *pool)
+{
+    uint32_t ps = spin_lock_irqsave(&pool->lock);
+
+    void **obj = (void **)pool->free_list;
+    if (obj) {
+        pool->free_list = *obj;
+        if (CONFIG_POOL_CHECK) {
+            obj[1] = NULL;
+        }
+        if (++pool->used > pool->peak) {
+            pool->peak = pool->used;
+        }
+    }
+
+    spin_unlock_irqrestore(&pool->lock, ps);
+    return obj;
+}
+
+/* Whether an object is already on the free list (pool lock held) */
+static bool pool_is_free(const pool_t *pool, void **obj)
+{
+    if (!CONFIG_POOL_CHECK || obj[1] != (void *)POOL_FREE_MARK) {
+        return false;
+    }
+    for (void **free = (void **)pool->free_list; free; free = (void **)*free) {
+        if (free == obj) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Return an object to its pool */
+void pool_free(pool_t *pool, void *obj)
+{
+    if (obj == NULL) {
+        return;
+    }
+
+    if (!pool_contains(pool, obj) ||
+        ((uint8_t *)obj - pool->storage) % pool->obj_size != 0) {
+        LOG_WARN("[POOL] WARNING: Invalid free to pool '%s'\n", pool->name);
+        return;
+    }
+
+    uint32_t ps = spin_lock_irqsave(&pool->lock);
+
+    /* A second free would hand the object out twice and underflow used */
+    if (pool->used == 0 || pool_is_free(pool, (void **)obj)) {
+        spin_unlock_irqrestore(&pool->lock, ps);
+        LOG_WARN("[POOL] WARNING: Double free to pool '%s'\n", pool->name);
+        return;
+    }
+
+    ((void **)obj)[0] = pool->free_list;
+    if (CONFIG_POOL_CHECK) {
+        ((void **)obj)[1] = (void *)POOL_FREE_MARK;
+    }
+    pool->free_list = obj;
+    pool->used--;
+    spin_unlock_irqrestore(&pool->lock, ps);
+}
+
+/* Check whether ptr points into the pool's storage */
+bool pool_contains(const pool_t *pool, const void *ptr)
+{
+    const uint8_t *p = (const uint8_t *)ptr;
+    return (p >= pool->storage &&
+            p < pool->storage + pool->capacity * pool->obj_size) ? true : false;
+}
+
+/* Get pool statistics (in objects) */
+void pool_stats(const pool_t *pool, uint32_t *total, uint32_t *used, uint32_t *free)
+{
+    if (total) *total = pool->capacity;
+    if (used) *used = pool->used;
+    if (free) *free = pool->capacity - pool->used;
+}
+
+/* Print statistics of every pool */
+void pool_dump_stats(void)
+{
+    for (pool_t *pool = pool_list; pool != NULL; pool = pool->next) {
+        uart_printf("[POOL] %s: %d/%d used (peak %d), %d bytes each\n",
+                    pool->name, pool->used, pool->capacity, pool->peak, pool->obj_size);
+    }
+}
@@ -0,0 +1,385 @@
+#include "queue.h"
+#include "kernel.h"
+#include "heap.h"
+#include "log.h"
+#include "xtensa.h"
+
+/*
+ * Blocking is layered on top of the lock-free rings: a task that finds
+ * its queue full (or empty) adds itself to the queue's senders (or
+ * receivers), rechecks, and blocks. The other side publishes its change
+ * before looking for waiters, with a full fence on both sides, so either
+ * the waiter sees the change or the other side sees the waiter.
+ */
+
+/* Whether a queue has room for a message, or has a message */
+typedef bool (*queue_ready_t)(const void *queue);
+
+/* Copy a message, a word at a time when sizes and addresses allow */
+static void queue_copy(void *dst, const void *src, uint32_t size)
+{
+    if (((uintptr_t)dst | (uintptr_t)src | size) & 3) {
+        uint8_t *d = (uint8_t *)dst;
+        const uint8_t *s = (const uint8_t *)src;
+        while (size--) {
+            *d++ = *s++;
+        }
+        return;
+    }
+
+    uint32_t *d = (uint32_t *)dst;
+    const uint32_t *s = (const uint32_t *)src;
+    for (size /= 4; size; size--) {
+        *d++ = *s++;
+    }
+}
+
+/* Wake one task waiting on wq, if any (after publishing a change) */
+static void queue_notify(waitq_t *wq)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (!waitq_peek(wq)) {
+        return;
+    }
+
+    uint32_t ps = spin_lock_irqsave(&scheduler_lock);
+    task_t *task = waitq_peek(wq);
+    if (task) {
+        waitq_wake(wq, task, 1);
+    }
+    waitq_unlock(ps);
+}
+
+/*
+ * Block on wq until woken or the deadline passes, unless ready() shows
+ * the queue has already changed. Returns false on timeout with nothing
+ * to retry, or if the caller can't block (timeout 0, no task,
+ * interrupts masked).
+ */
+static bool queue_wait(waitq_t *wq, queue_ready_t ready, const void *queue,
+                       uint32_t timeout_ms, uint32_t deadline)
+{
+    uint32_t ps = spin_lock_irqsave(&scheduler_lock);
+    task_t *current = task_get_current_on(xt_core_id());
+
+    if (timeout_ms == 0 || !current || (ps & PS_INTLEVEL_MASK) != 0) {
+        spin_unlock_irqrestore(&scheduler_lock, ps);
+        return false;
+    }
+
+    /* Publish the waiter before rechecking; pairs with queue_notify() */
+    waitq_insert(wq, current);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    bool woken = true;
+    if (!ready(queue)) {
+        if (timeout_ms == TASK_WAIT_FOREVER) {
+            task_block_locked();
+        } else {
+            woken = task_block_until_locked(deadline);
+        }
+        spin_lock(&scheduler_lock);
+    }
+    waitq_remove(wq, current);
+
+    /*
+     * queue_notify() wakes a single waiter, so a timed-out waiter that
+     * was also picked, or that finds the queue ready, retries rather
+     * than give up and strand that wakeup.
+     */
+    if (!woken && (current->wait_value || ready(queue))) {
+        woken = true;
+    }
+
+    spin_unlock_irqrestore(&scheduler_lock, ps);
+    return woken;
+}
+
+/* Check a capacity and return its index mask, or 0 if it isn't a power of two >= 2 */
+static uint32_t queue_mask(uint32_t capacity)
+{
+    if (capacity < 2 || (capacity & (capacity - 1))) {
+        LOG_ERROR("[QUEUE] ERROR: Capacity %d is not a power of two\n", capacity);
+        return 0;
+    }
+    return capacity - 1;
+}
+
+/* ===== Single producer, single consumer ===== */
+
+static bool spsc_queue_has_space(const void *q)
+{
+    const spsc_queue_t *queue = (const spsc_queue_t *)q;
+    return queue->tail - queue->head <= queue->mask;
+}
+
+static bool spsc_queue_has_data(const void *q)
+{
+    const spsc_queue_t *queue = (const spsc_queue_t *)q;
+    return queue->tail != queue->head;
+}
+
+/* Initialize an SPSC queue over caller-provided storage */
+bool spsc_queue_init(spsc_queue_t *queue, uint32_t item_size, uint32_t capacity, void *storage)
+{
+    uint32_t mask = queue_mask(capacity);
+    if (!mask) {
+        return false;
+    }
+
+    queue->buffer = (uint8_t *)storage;
+    queue->item_size = item_size;
+    queue->mask = mask;
+    queue->head = 0;
+    queue->tail = 0;
+    waitq_init(&queue->senders, WAITQ_FIFO);
+    waitq_init(&queue->receivers, WAITQ_FIFO);
+
+    return true;
+}
+
+/* Create an SPSC queue whose header and storage come from one heap allocation */
+spsc_queue_t *spsc_queue_create(uint32_t item_size, uint32_t capacity)
+{
+    uint32_t header = ALIGN_UP(sizeof(spsc_queue_t), 4);
+    uint8_t *mem = (uint8_t *)kmalloc(header + item_size * capacity);
+    if (!mem) {
+        LOG_ERROR("[QUEUE] ERROR: Failed to allocate queue (%d x %d bytes)\n", capacity, item_size);
+        return NULL;
+    }
+
+    spsc_queue_t *queue = (spsc_queue_t *)mem;
+    if (!spsc_queue_init(queue, item_size, capacity, mem + header)) {
+        kfree(mem);
+        return NULL;
+    }
+    return queue;
+}
+
+/* Send a message if there is space */
+bool spsc_queue_try_send(spsc_queue_t *queue, const void *item)
+{
+    uint32_t tail = queue->tail;
+
+    if (tail - __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE) > queue->mask) {
+        return false;
+    }
+
+    queue_copy(queue->buffer + (tail & queue->mask) * queue->item_size, item, queue->item_size);
+    __atomic_store_n(&queue->tail, tail + 1, __ATOMIC_RELEASE);
+
+    queue_notify(&queue->receivers);
+    return true;
+}
+
+/* Receive a message if there is one */
+bool spsc_queue_try_recv(spsc_queue_t *queue, void *item)
+{
+    uint32_t head = queue->head;
+
+    if (head == __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+
+    queue_copy(item, queue->buffer + (head & queue->mask) * queue->item_size, queue->item_size);
+    __atomic_store_n(&queue->head, head + 1, __ATOMIC_RELEASE);
+
+    queue_notify(&queue->senders);
+    return true;
+}
+
+/* Send a message, waiting up to timeout_ms for space */
+bool spsc_queue_send(spsc_queue_t *queue, const void *item, uint32_t timeout_ms)
+{
+    uint32_t deadline = scheduler_get_ticks() + ms_to_ticks(timeout_ms) + 1;
+
+    while (!spsc_queue_try_send(queue, item)) {
+        if (!queue_wait(&queue->senders, spsc_queue_has_space, queue, timeout_ms, deadline)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Receive a message, waiting up to timeout_ms for one */
+bool spsc_queue_recv(spsc_queue_t *queue, void *item, uint32_t timeout_ms)
+{
+    uint32_t deadline = scheduler_get_ticks() + ms_to_ticks(timeout_ms) + 1;
+
+    while (!spsc_queue_try_recv(queue, item)) {
+        if (!queue_wait(&queue->receivers, spsc_queue_has_data, queue, timeout_ms, deadline)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Messages currently queued */
+uint32_t spsc_queue_count(const spsc_queue_t *queue)
+{
+    return queue->tail - queue->head;
+}
+
+/* ===== Multiple producers, multiple consumers ===== */
+
+/*
+ * Each slot starts with a sequence word. For the slot at position pos
+ * (mod capacity) it reads pos while the slot is free for that position's
+ * sender, and pos + 1 once the message is in. A receiver frees it for
+ * the next lap by storing pos + capacity. Senders and receivers claim
+ * positions by advancing tail and head with S32C1I, then fill or empty
+ * the slot without further synchronization.
+ */
+static inline volatile uint32_t *mpmc_queue_slot(const mpmc_queue_t *queue, uint32_t pos)
+{
+    return (volatile uint32_t *)(queue->slots + (pos & queue->mask) * queue->slot_size);
+}
+
+static bool mpmc_queue_has_space(const void *q)
+{
+    const mpmc_queue_t *queue = (const mpmc_queue_t *)q;
+    uint32_t pos = queue->tail;
+    return *mpmc_queue_slot(queue, pos) == pos;
+}
+
+static bool mpmc_queue_has_data(const void *q)
+{
+    const mpmc_queue_t *queue = (const mpmc_queue_t *)q;
+    uint32_t pos = queue->head;
+    return *mpmc_queue_slot(queue, pos) == pos + 1;
+}
+
+/* Initialize an MPMC queue over caller-provided storage */
+bool mpmc_queue_init(mpmc_queue_t *queue, uint32_t item_size, uint32_t capacity, void *storage)
+{
+    uint32_t mask = queue_mask(capacity);
+    if (!mask) {
+        return false;
+    }
+
+    queue->slots = (uint8_t *)storage;
+    queue->item_size = item_size;
+    queue->slot_size = MPMC_QUEUE_SLOT_SIZE(item_size);
+    queue->mask = mask;
+    queue->head = 0;
+    queue->tail = 0;
+    waitq_init(&queue->senders, WAITQ_FIFO);
+    waitq_init(&queue->receivers, WAITQ_FIFO);
+
+    for (uint32_t pos = 0; pos < capacity; pos++) {
+        *mpmc_queue_slot(queue, pos) = pos;
+    }
+
+    return true;
+}
+
+/* Create an MPMC queue whose header and storage come from one heap allocation */
+mpmc_queue_t *mpmc_queue_create(uint32_t item_size, uint32_t capacity)
+{
+    uint32_t header = ALIGN_UP(sizeof(mpmc_queue_t), 4);
+    uint8_t *mem = (uint8_t *)kmalloc(header + MPMC_QUEUE_SLOT_SIZE(item_size) * capacity);
+    if (!mem) {
+        LOG_ERROR("[QUEUE] ERROR: Failed to allocate queue (%d x %d bytes)\n", capacity, item_size);
+        return NULL;
+    }
+
+    mpmc_queue_t *queue = (mpmc_queue_t *)mem;
+    if (!mpmc_queue_init(queue, item_size, capacity, mem + header)) {
+        kfree(mem);
+        return NULL;
+    }
+    return queue;
+}
+
+/* Send a message if there is space */
+bool mpmc_queue_try_send(mpmc_queue_t *queue, const void *item)
+{
+    uint32_t pos = queue->tail;
+    volatile uint32_t *slot;
+
+    for (;;) {
+        slot = mpmc_queue_slot(queue, pos);
+        int32_t diff = (int32_t)(__atomic_load_n(slot, __ATOMIC_ACQUIRE) - pos);
+
+        if (diff == 0) {
+            uint32_t seen = xt_compare_set(&queue->tail, pos, pos + 1);
+            if (seen == pos) {
+                break;
+            }
+            pos = seen;
+        } else if (diff < 0) {
+            return false;               /* Full: the slot is a lap behind */
+        } else {
+            pos = queue->tail;          /* Another sender took this position */
+        }
+    }
+
+    queue_copy((void *)(slot + 1), item, queue->item_size);
+    __atomic_store_n(slot, pos + 1, __ATOMIC_RELEASE);
+
+    queue_notify(&queue->receivers);
+    return true;
+}
+
+/* Receive a message if there is one */
+bool mpmc_queue_try_recv(mpmc_queue_t *queue, void *item)
+{
+    uint32_t pos = queue->head;
+    volatile uint32_t *slot;
+
+    for (;;) {
+        slot = mpmc_queue_slot(queue, pos);
+        int32_t diff = (int32_t)(__atomic_load_n(slot, __ATOMIC_ACQUIRE) - (pos + 1));
+
+        if (diff == 0) {
+            uint32_t seen = xt_compare_set(&queue->head, pos, pos + 1);
+            if (seen == pos) {
+                break;
+            }
+            pos = seen;
+        } else if (diff < 0) {
+            return false;               /* Empty: not written yet */
+        } else {
+            pos = queue->head;          /* Another receiver took this position */
+        }
+    }
+
+    queue_copy(item, (const void *)(slot + 1), queue->item_size);
+    __atomic_store_n(slot, pos + queue->mask + 1, __ATOMIC_RELEASE);
+
+    queue_notify(&queue->senders);
+    return true;
+}
+
+/* Send a message, waiting up to timeout_ms for space */
+bool mpmc_queue_send(mpmc_queue_t *queue, const void *item, uint32_t timeout_ms)
+{
+    uint32_t deadline = scheduler_get_ticks() + ms_to_ticks(timeout_ms) + 1;
+
+    while (!mpmc_queue_try_send(queue, item)) {
+        if (!queue_wait(&queue->senders, mpmc_queue_has_space, queue, timeout_ms, deadline)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Receive a message, waiting up to timeout_ms for one */
+bool mpmc_queue_recv(mpmc_queue_t *queue, void *item, uint32_t timeout_ms)
+{
+    uint32_t deadline = scheduler_get_ticks() + ms_to_ticks(timeout_ms) + 1;
+
+    while (!mpmc_queue_try_recv(queue, item)) {
+        if (!queue_wait(&queue->receivers, mpmc_queue_has_data, queue, timeout_ms, deadline)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Messages currently queued */
+uint32_t mpmc_queue_count(const mpmc_queue_t *queue)
+{
+    uint32_t count = queue->tail - queue->head;
+    return MIN(count, queue->mask + 1);
+}
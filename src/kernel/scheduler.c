@@ -1,97 +1,750 @@
 #include "kernel.h"
 #include "task.h"
+#include "fpu.h"
+#include "trace.h"
+#include "interrupt.h"
 #include "uart.h"
+#include "log.h"
+#include "smp.h"
 #include "esp32_defs.h"
+#include "xtensa.h"
 
-/* Scheduler state */
-static bool scheduler_running = false;
+/* CCOUNT cycles per system tick */
+#define TICK_CYCLES  (CPU_CLK_FREQ / CONFIG_TICK_HZ)
+
+/* Never program CCOMPARE0 closer than this, or the match could be missed */
+#define TICK_MIN_CYCLES  64
+
+/* Longest tickless sleep, keeping the deadline within half the CCOUNT range */
+#define IDLE_MAX_TICKS  (0x7FFFFFFF / TICK_CYCLES)
+
+/*
+ * Guards the run queues, the sleep queue, the tick and every task's
+ * scheduling state, on both cores. Always taken with interrupts masked.
+ */
+spinlock_t scheduler_lock = SPINLOCK_INIT;
+
+/*
+ * Scheduler state. The cores' CCOUNTs are synchronized at boot, so the
+ * tick is shared: whichever core's CCOMPARE0 fires accounts for the
+ * elapsed ticks and wakes sleepers.
+ */
+static volatile bool scheduler_running = false;
+static volatile uint32_t tick_count = 0;
+static uint32_t tick_base = 0;          /* CCOUNT at the start of the current tick */
+static uint64_t tick_base_cycles = 0;   /* Cycles from scheduler start to tick_base */
+
+/* Per-core idle state, residency statistics and pending preemption */
+typedef struct {
+    volatile bool tickless_idle;
+    uint32_t idle_start;
+    uint64_t idle_cycles;
+    uint32_t idle_sleeps;
+    volatile bool switch_pending;       /* Set by the tick when current should be preempted */
+    uint32_t switch_start;              /* CCOUNT when the last switch began */
+    sched_latency_t latency;            /* Only touched by this core, interrupts masked */
+} sched_core_t;
+
+static sched_core_t sched_core[CONFIG_NUM_CORES];
+
+/* Sleeping tasks, sorted by wake tick (earliest first) */
+static task_t *sleep_head = NULL;
+
+/* Count a latency sample in its log2 bucket (NSAU, so a few cycles) */
+static inline void sched_hist_add(uint32_t *hist, uint32_t cycles)
+{
+    uint32_t bucket = 31 - __builtin_clz(cycles | 1);
+
+    hist[MIN(bucket, SCHED_HIST_BUCKETS - 1)]++;
+}
+
+/* Charge current for its run and start next's (scheduler_lock held) */
+static void sched_account(task_t *current, task_t *next, bool involuntary)
+{
+    uint32_t now = xt_get_ccount();
+
+    if (current) {
+        current->stats.run_cycles += now - current->run_start;
+        if (involuntary) {
+            current->stats.involuntary++;
+        } else {
+            current->stats.voluntary++;
+        }
+    }
+
+    next->run_start = now;
+    if (next->ready_since) {
+        sched_hist_add(sched_core[xt_core_id()].latency.wake_latency, now - next->ready_since);
+        next->ready_since = 0;
+    }
+}
+
+/* Note when a blocked task becomes ready, for the wake latency histogram */
+static inline void sched_mark_woken(task_t *task)
+{
+    if (CONFIG_SCHED_STATS) {
+        /* Never 0, which means not woken */
+        task->ready_since = xt_get_ccount() | 1;
+    }
+}
+
+/*
+ * Choose the task to run after current on this core. Returns NULL if
+ * current should keep running. preempt says whether a still runnable
+ * current is being preempted rather than yielding. Call with
+ * scheduler_lock held.
+ */
+static task_t *scheduler_pick_next(task_t *current, bool preempt)
+{
+    bool runnable = current && current->state == TASK_STATE_RUNNING;
+
+    /*
+     * The running task keeps the CPU unless an equal or higher priority
+     * task is ready, or it has been pinned to another core
+     */
+    if (runnable) {
+        bool allowed = current->affinity == TASK_AFFINITY_ANY ||
+                       current->affinity == (int32_t)xt_core_id();
+        if (allowed && task_ready_priority() < (int)current->priority) {
+            return NULL;
+        }
+        task_make_ready(current);
+    }
+
+    task_t *next = task_get_next_ready();
+    if (!next) {
+        return NULL;
+    }
+
+    if (next != current) {
+        if (current) {
+            if (CONFIG_STACK_CHECK && !task_stack_intact(current)) {
+                task_stack_overflow(current);
+            }
+            fpu_switch_out(current);
+            TRACE(TRACE_TASK_SWITCH_OUT, current->id);
+            if (current->state == TASK_STATE_TERMINATED) {
+                task_retire_locked(current);
+            }
+        }
+        TRACE(TRACE_TASK_SWITCH_IN, next->id);
+        if (CONFIG_SCHED_STATS) {
+            sched_account(current, next, preempt && runnable);
+        }
+    }
+
+    /* Set next task as running with a fresh time slice */
+    next->state = TASK_STATE_RUNNING;
+    next->slice_left = next->time_slice;
+    task_set_current(next);
+
+    return (next == current) ? NULL : next;
+}
+
+/* Insert a task into the sleep queue, keeping it sorted by wake tick */
+static void sleep_queue_insert(task_t *task)
+{
+    task_t *prev = NULL;
+    task_t *cur = sleep_head;
+
+    /* Equal deadlines keep FIFO order */
+    while (cur && (int32_t)(cur->wake_tick - task->wake_tick) <= 0) {
+        prev = cur;
+        cur = cur->sleep_next;
+    }
+
+    task->sleep_prev = prev;
+    task->sleep_next = cur;
+    if (cur) {
+        cur->sleep_prev = task;
+    }
+    if (prev) {
+        prev->sleep_next = task;
+    } else {
+        sleep_head = task;
+    }
+}
+
+/* Take a task off the sleep queue before its deadline */
+static void sleep_queue_remove(task_t *task)
+{
+    if (task->sleep_prev) {
+        task->sleep_prev->sleep_next = task->sleep_next;
+    } else if (sleep_head == task) {
+        sleep_head = task->sleep_next;
+    } else {
+        return;     /* Not sleeping */
+    }
+    if (task->sleep_next) {
+        task->sleep_next->sleep_prev = task->sleep_prev;
+    }
+    task->sleep_next = NULL;
+    task->sleep_prev = NULL;
+}
+
+/* Move every task whose deadline has passed to the ready queues */
+static void sleep_queue_wake(uint32_t now)
+{
+    while (sleep_head && (int32_t)(now - sleep_head->wake_tick) >= 0) {
+        task_t *task = sleep_head;
+
+        sleep_head = task->sleep_next;
+        if (sleep_head) {
+            sleep_head->sleep_prev = NULL;
+        }
+        task->sleep_next = NULL;
+        task->sleep_prev = NULL;
+
+        /* task_wake() takes a task off this queue, so only deadlines get here */
+        task->timed_out = true;
+        sched_mark_woken(task);
+        task_make_ready(task);
+    }
+}
+
+/* Account for every tick period elapsed up to now and wake due sleepers */
+static void tick_announce(void)
+{
+    uint32_t elapsed = xt_get_ccount() - tick_base;
+
+    if (elapsed >= TICK_CYCLES) {
+        uint32_t ticks = (elapsed < 2 * TICK_CYCLES) ? 1 : elapsed / TICK_CYCLES;
+        tick_base += ticks * TICK_CYCLES;
+        tick_base_cycles += (uint64_t)ticks * TICK_CYCLES;
+        tick_count += ticks;
+        sleep_queue_wake(tick_count);
+    }
+}
+
+/*
+ * Cycles since the scheduler started (scheduler_lock held). Some core
+ * runs tick_announce() well within the 2^32-cycle CCOUNT period, even
+ * in tickless idle, so CCOUNT - tick_base never wraps.
+ */
+static uint64_t clock_cycles_locked(void)
+{
+    return tick_base_cycles + (xt_get_ccount() - tick_base);
+}
+
+/* Program the tick interrupt for the given number of ticks after tick_base */
+static void tick_program(uint32_t ticks)
+{
+    uint32_t target = tick_base + ticks * TICK_CYCLES;
+    uint32_t now = xt_get_ccount();
+
+    if ((int32_t)(target - now) < TICK_MIN_CYCLES) {
+        target = now + TICK_MIN_CYCLES;
+    }
+    xt_set_ccompare0(target);
+}
+
+/* Leave tickless idle: catch up on skipped ticks and resume the periodic tick */
+static void idle_exit(sched_core_t *sc)
+{
+    if (!sc->tickless_idle) {
+        return;
+    }
+
+    sc->tickless_idle = false;
+    sc->idle_cycles += xt_get_ccount() - sc->idle_start;
+    tick_announce();
+    tick_program(1);
+}
+
+/*
+ * Switch this core to the next task, if there is one. Called with
+ * scheduler_lock held and returns with it released: context_switch
+ * drops it only once it is off the old task's stack, so another core
+ * can't resume that task while this one still uses its stack.
+ */
+static void scheduler_switch_locked(bool preempt)
+{
+    uint32_t core = xt_core_id();
+    task_t *current = task_get_current_on(core);
+
+    if (CONFIG_SCHED_STATS) {
+        sched_core[core].switch_start = xt_get_ccount();
+    }
+
+    task_t *next = scheduler_pick_next(current, preempt);
+
+    if (next) {
+        sched_core[core].switch_pending = false;
+        context_switch(&current->stack_ptr, next->stack_ptr);
+
+        /*
+         * Back in this task, possibly on the other core. Switches that
+         * resume a task at an interrupted instruction aren't sampled.
+         */
+        if (CONFIG_SCHED_STATS) {
+            sched_core_t *sc = &sched_core[xt_core_id()];
+            sched_hist_add(sc->latency.switch_latency, xt_get_ccount() - sc->switch_start);
+        }
+        return;
+    }
+
+    bool stuck = current && current->state != TASK_STATE_RUNNING;
+    spin_unlock(&scheduler_lock);
+
+    if (stuck) {
+        LOG_WARN("[SCHED] WARNING: No ready tasks, staying with current\n");
+    }
+}
+
+/* CCOMPARE0 tick interrupt */
+static void scheduler_tick_handler(void *arg)
+{
+    scheduler_tick();
+}
 
 /* Initialize scheduler */
 void scheduler_init(void)
 {
     uart_puts("[SCHED] Scheduler initialized\n");
     scheduler_running = false;
+    tick_count = 0;
+    tick_base_cycles = 0;
+    sleep_head = NULL;
+
+    for (uint32_t core = 0; core < CONFIG_NUM_CORES; core++) {
+        sched_core[core].tickless_idle = false;
+        sched_core[core].idle_cycles = 0;
+        sched_core[core].idle_sleeps = 0;
+        sched_core[core].switch_pending = false;
+        for (uint32_t i = 0; i < SCHED_HIST_BUCKETS; i++) {
+            sched_core[core].latency.switch_latency[i] = 0;
+            sched_core[core].latency.wake_latency[i] = 0;
+        }
+    }
 }
 
 /* Start the scheduler (never returns) */
 void scheduler_start(void)
 {
     uart_puts("[SCHED] Starting scheduler...\n");
-    scheduler_running = true;
+
+    /* Interrupts stay masked until the first task's frame is restored */
+    xt_irq_save();
+    interrupt_register_handler(XT_TIMER0_INUM, scheduler_tick_handler, NULL);
 
     /* Get first ready task */
+    spin_lock(&scheduler_lock);
     task_t *first_task = task_get_next_ready();
     if (!first_task) {
+        spin_unlock(&scheduler_lock);
         uart_puts("[SCHED] ERROR: No tasks to run!\n");
         while(1);
     }
 
     /* Set as current task */
     first_task->state = TASK_STATE_RUNNING;
+    first_task->run_start = xt_get_ccount();
     task_set_current(first_task);
+    TRACE(TRACE_TASK_SWITCH_IN, first_task->id);
+
+    /* Start the system tick */
+    tick_base = xt_get_ccount();
+    tick_program(1);
+    scheduler_running = true;
+    spin_unlock(&scheduler_lock);
+
+    interrupt_enable_source(XT_TIMER0_INUM);
 
     uart_printf("[SCHED] Starting task '%s'\n", first_task->name);
+    if (CONFIG_PREEMPTION) {
+        uart_printf("[SCHED] Preemption enabled (%d Hz tick)\n", CONFIG_TICK_HZ);
+    }
+
+    /* The other cores start on the tasks left in the run queues */
+    smp_start_app_cpu();
+
+    /* Jump to first task (assembly), which also re-enables interrupts */
+    context_start(first_task->stack_ptr);
+}
+
+/* Start scheduling on a secondary core (never returns) */
+void scheduler_start_secondary(void)
+{
+    xt_irq_save();
+
+    /* At least this core's pinned idle task is waiting */
+    spin_lock(&scheduler_lock);
+    task_t *first_task = task_get_next_ready();
+    if (!first_task) {
+        spin_unlock(&scheduler_lock);
+        LOG_ERROR("[SCHED] ERROR: No tasks to run on core %d\n", xt_core_id());
+        while(1);
+    }
+
+    first_task->state = TASK_STATE_RUNNING;
+    first_task->slice_left = first_task->time_slice;
+    first_task->run_start = xt_get_ccount();
+    task_set_current(first_task);
+    TRACE(TRACE_TASK_SWITCH_IN, first_task->id);
+    tick_program(1);
+    spin_unlock(&scheduler_lock);
+
+    interrupt_enable_source(XT_TIMER0_INUM);
+
+    context_start(first_task->stack_ptr);
+}
 
-    /* Jump to first task (assembly) */
-    /* We need to restore the context and jump to the task */
-    __asm__ volatile (
-        "mov a1, %0\n"          /* Load stack pointer */
-        "l32i a0, a1, 0\n"      /* Load A0 */
-        "l32i a2, a1, 4\n"      /* Load A2 (arg) */
-        "l32i a15, a1, 60\n"    /* Load PC */
-        "l32i a14, a1, 64\n"    /* Load PS */
-        "wsr a14, ps\n"         /* Restore PS */
-        "rsync\n"
-        "jx a15\n"              /* Jump to task entry */
-        : : "r" (first_task->stack_ptr)
-    );
-
-    /* Should never reach here */
-    while(1);
-}
-
-/* Schedule next task (called by task_yield) */
+/*
+ * Schedule next task (called by task_yield). May be called with
+ * interrupts already masked; the caller's interrupt state is restored
+ * when this task next runs.
+ */
 void scheduler_schedule(void)
 {
     if (!scheduler_running) {
         return;
     }
 
-    task_t *current = task_get_current();
-    task_t *next = task_get_next_ready();
+    uint32_t ps = spin_lock_irqsave(&scheduler_lock);
+    scheduler_switch_locked(false);
+    xt_irq_restore(ps);
+}
 
-    if (!next) {
-        uart_puts("[SCHED] WARNING: No ready tasks, staying with current\n");
+/*
+ * Give the CPU to a higher priority task ready on this core, e.g. after
+ * the current task lost a priority boost. Called with scheduler_lock
+ * held and returns with it released.
+ */
+void scheduler_reschedule_locked(void)
+{
+    task_t *current = task_get_current_on(xt_core_id());
+
+    if (scheduler_running && current && task_ready_priority() > (int)current->priority) {
+        scheduler_switch_locked(true);
+    } else {
+        spin_unlock(&scheduler_lock);
+    }
+}
+
+/* System tick handler (called from the tick interrupt on either core) */
+void scheduler_tick(void)
+{
+    uint32_t core = xt_core_id();
+    sched_core_t *sc = &sched_core[core];
+
+    /* Runs at level 1: keep out level-2/3 handlers that wake tasks */
+    uint32_t ps = spin_lock_irqsave(&scheduler_lock);
+
+    if (sc->tickless_idle) {
+        idle_exit(sc);
+    } else {
+        /* Wake sleepers; in preemptive mode a higher priority one runs on interrupt exit */
+        tick_announce();
+        tick_program(1);
+    }
+
+    /* Preempt the current task when its time slice is used up */
+    task_t *current = task_get_current_on(core);
+    if (CONFIG_PREEMPTION && scheduler_running && current && current->time_slice &&
+        current->slice_left && --current->slice_left == 0) {
+        if (task_ready_priority() >= (int)current->priority) {
+            sc->switch_pending = true;
+        } else {
+            current->slice_left = current->time_slice;
+        }
+    }
+
+    spin_unlock_irqrestore(&scheduler_lock, ps);
+}
+
+/*
+ * Pick the frame to resume on interrupt exit (called from the level-1
+ * vector with levels 1-3 masked). When it returns a different frame
+ * scheduler_lock is still held; the vector releases it once it has
+ * moved onto the new stack.
+ */
+uint32_t *scheduler_isr_switch(uint32_t *frame)
+{
+    uint32_t core = xt_core_id();
+    sched_core_t *sc = &sched_core[core];
+    uint32_t start = xt_get_ccount();
+
+    spin_lock(&scheduler_lock);
+
+    /* Any interrupt ends a tickless sleep, not just the tick */
+    idle_exit(sc);
+
+    /* Time slice expiry, or a higher priority task was made ready */
+    task_t *current = task_get_current_on(core);
+    if (CONFIG_PREEMPTION && scheduler_running && current &&
+        (sc->switch_pending || task_ready_priority() > (int)current->priority)) {
+        sc->switch_pending = false;
+
+        sc->switch_start = start;
+        task_t *next = scheduler_pick_next(current, true);
+        if (next) {
+            current->stack_ptr = frame;
+            return next->stack_ptr;
+        }
+    }
+
+    spin_unlock(&scheduler_lock);
+    return frame;
+}
+
+/* Idle loop body: run ready tasks, otherwise halt until the next interrupt */
+void scheduler_idle(void)
+{
+    sched_core_t *sc = &sched_core[xt_core_id()];
+    uint32_t ps = spin_lock_irqsave(&scheduler_lock);
+
+    /* Includes work this core could steal from another */
+    if (task_ready_priority() >= 0) {
+        spin_unlock_irqrestore(&scheduler_lock, ps);
+        task_yield();
         return;
     }
 
-    if (next == current) {
-        /* Same task, no need to switch */
+    /* Nothing to run: stop the periodic tick until the next sleeper is due */
+    uint32_t ticks = 1;
+    if (CONFIG_TICKLESS_IDLE) {
+        ticks = IDLE_MAX_TICKS;
+        if (sleep_head && sleep_head->wake_tick - tick_count < ticks) {
+            ticks = sleep_head->wake_tick - tick_count;
+        }
+    }
+
+    tick_program(ticks);
+    sc->tickless_idle = true;
+    sc->idle_sleeps++;
+    sc->idle_start = xt_get_ccount();
+    spin_unlock(&scheduler_lock);
+
+    /*
+     * Drops INTLEVEL to 0 and halts atomically, so no wakeup can be
+     * missed. Work queued by another core arrives as a cross-core
+     * interrupt.
+     */
+    __asm__ volatile ("waiti 0" : : : "memory");
+
+    /* Woken by an interrupt that didn't go through the level-1 path */
+    spin_lock_irqsave(&scheduler_lock);
+    idle_exit(sc);
+    spin_unlock_irqrestore(&scheduler_lock, ps);
+}
+
+/* Get a core's idle residency statistics */
+void scheduler_idle_stats(uint32_t core, uint64_t *idle, uint64_t *total, uint32_t *sleeps)
+{
+    if (core >= CONFIG_NUM_CORES) {
         return;
     }
 
-    /* Save current task state */
-    if (current && current->state == TASK_STATE_RUNNING) {
-        current->state = TASK_STATE_READY;
+    sched_core_t *sc = &sched_core[core];
+    uint32_t ps = spin_lock_irqsave(&scheduler_lock);
+    if (idle) *idle = sc->idle_cycles;
+    if (total) *total = clock_cycles_locked();
+    if (sleeps) *sleeps = sc->idle_sleeps;
+    spin_unlock_irqrestore(&scheduler_lock, ps);
+}
+
+/* Sum both cores' latency histograms */
+void scheduler_latency_stats(sched_latency_t *stats)
+{
+    for (uint32_t i = 0; i < SCHED_HIST_BUCKETS; i++) {
+        stats->switch_latency[i] = 0;
+        stats->wake_latency[i] = 0;
     }
 
-    /* Set next task as running */
-    next->state = TASK_STATE_RUNNING;
-    task_set_current(next);
+    /* Each core updates its own without the lock; a sample may be missed, never torn */
+    for (uint32_t core = 0; core < CONFIG_NUM_CORES; core++) {
+        const sched_latency_t *lat = &sched_core[core].latency;
+        for (uint32_t i = 0; i < SCHED_HIST_BUCKETS; i++) {
+            stats->switch_latency[i] += lat->switch_latency[i];
+            stats->wake_latency[i] += lat->wake_latency[i];
+        }
+    }
+}
 
-    /* Perform context switch */
-    if (current) {
-        context_switch(&current->stack_ptr, next->stack_ptr);
+/* Print the non-empty buckets of one histogram */
+static void sched_dump_hist(const char *what, const uint32_t *hist)
+{
+    uart_printf("[SCHED] %s latency (cycles):\n", what);
+    for (uint32_t i = 0; i < SCHED_HIST_BUCKETS; i++) {
+        if (!hist[i]) {
+            continue;
+        }
+        if (i == SCHED_HIST_BUCKETS - 1) {
+            uart_printf("[SCHED]   >= %8u: %u\n", 1U << i, hist[i]);
+        } else {
+            uart_printf("[SCHED]   <  %8u: %u\n", 2U << i, hist[i]);
+        }
+    }
+}
+
+/* Print the latency histograms */
+void scheduler_dump_latency(void)
+{
+    sched_latency_t stats;
+
+    scheduler_latency_stats(&stats);
+    sched_dump_hist("Switch", stats.switch_latency);
+    sched_dump_hist("Wake", stats.wake_latency);
+}
+
+/* Number of system ticks since the scheduler started */
+uint32_t scheduler_get_ticks(void)
+{
+    return tick_count;
+}
+
+/* CCOUNT cycles since the scheduler started, as a 64-bit count that never wraps */
+uint64_t scheduler_get_cycles(void)
+{
+    uint32_t ps = spin_lock_irqsave(&scheduler_lock);
+    uint64_t cycles = clock_cycles_locked();
+    spin_unlock_irqrestore(&scheduler_lock, ps);
+
+    return cycles;
+}
+
+/* Microseconds since the scheduler started */
+uint64_t scheduler_get_time_us(void)
+{
+    return scheduler_get_cycles() / (CPU_CLK_FREQ / 1000000);
+}
+
+/* Block the current task until the system tick reaches wake_tick */
+void task_sleep_until(uint32_t wake_tick)
+{
+    task_t *current = task_get_current();
+
+    if (!scheduler_running || !current) {
+        return;
+    }
+
+    uint32_t ps = spin_lock_irqsave(&scheduler_lock);
+
+    if ((int32_t)(wake_tick - tick_count) > 0) {
+        current->state = TASK_STATE_BLOCKED;
+        current->wake_tick = wake_tick;
+        sleep_queue_insert(current);
+
+        /* Switch away still holding the lock so the tick can't wake us first */
+        scheduler_switch_locked(false);
     } else {
-        /* No previous task, just restore next task context */
-        __asm__ volatile (
-            "mov a1, %0\n"
-            : : "r" (next->stack_ptr)
-        );
+        spin_unlock(&scheduler_lock);
+    }
+
+    xt_irq_restore(ps);
+}
+
+/* Consume a wakeup that arrived while the task was still running (lock held) */
+static bool task_take_wakeup(task_t *task)
+{
+    if (task->wake_pending) {
+        task->wake_pending = false;
+        return true;
     }
+    return false;
+}
+
+/*
+ * Block the current task until task_wake(). Call with interrupts masked,
+ * after publishing the task wherever its waker will find it. A waker on
+ * the other core may get in before the task has blocked; that wakeup is
+ * remembered and makes this return straight away.
+ */
+void task_block(void)
+{
+    task_t *current = task_get_current();
+
+    if (!scheduler_running || !current) {
+        return;
+    }
+
+    spin_lock(&scheduler_lock);
+    task_block_locked();
+}
+
+/* As task_block(), called with scheduler_lock held; returns with it released */
+void task_block_locked(void)
+{
+    task_t *current = task_get_current_on(xt_core_id());
+
+    if (task_take_wakeup(current)) {
+        spin_unlock(&scheduler_lock);
+        return;
+    }
+
+    current->state = TASK_STATE_BLOCKED;
+    scheduler_switch_locked(false);
+}
+
+/*
+ * As task_block(), but give up once the system tick reaches wake_tick.
+ * Returns false if the deadline passed without a task_wake().
+ */
+bool task_block_until(uint32_t wake_tick)
+{
+    task_t *current = task_get_current();
+
+    if (!scheduler_running || !current) {
+        return false;
+    }
+
+    spin_lock(&scheduler_lock);
+    return task_block_until_locked(wake_tick);
+}
+
+/* As task_block_until(), called with scheduler_lock held; returns with it released */
+bool task_block_until_locked(uint32_t wake_tick)
+{
+    task_t *current = task_get_current_on(xt_core_id());
+
+    if ((int32_t)(wake_tick - tick_count) <= 0) {
+        spin_unlock(&scheduler_lock);
+        return false;
+    }
+    if (task_take_wakeup(current)) {
+        spin_unlock(&scheduler_lock);
+        return true;
+    }
+
+    current->state = TASK_STATE_BLOCKED;
+    current->wake_tick = wake_tick;
+    current->timed_out = false;
+    sleep_queue_insert(current);
+    scheduler_switch_locked(false);
+
+    /* Not the tick count: a task_wake() on the deadline tick still counts */
+    return !current->timed_out;
+}
+
+/* Make a blocked task ready again (safe from interrupt handlers and either core) */
+void task_wake(task_t *task)
+{
+    uint32_t ps = spin_lock_irqsave(&scheduler_lock);
+    task_wake_locked(task);
+    spin_unlock_irqrestore(&scheduler_lock, ps);
+}
+
+/* As task_wake(), called with scheduler_lock held */
+void task_wake_locked(task_t *task)
+{
+    if (task->state == TASK_STATE_BLOCKED) {
+        sleep_queue_remove(task);
+        sched_mark_woken(task);
+        task_make_ready(task);
+    } else if (task->state == TASK_STATE_RUNNING && task != task_get_current_on(xt_core_id())) {
+        /* Running on the other core on its way to blocking */
+        task->wake_pending = true;
+    }
+}
+
+/* Block the current task for at least ms milliseconds */
+void task_sleep_ms(uint32_t ms)
+{
+    /* One extra tick: the current tick period is already partly over */
+    task_sleep_until(tick_count + ms_to_ticks(ms) + 1);
 }
 
-/* Delay in milliseconds */
+/* Busy-wait delay in milliseconds (use task_sleep_ms to give up the CPU) */
 void delay_ms(uint32_t ms)
 {
     for (uint32_t i = 0; i < ms; i++) {
@@ -99,7 +752,7 @@ void delay_ms(uint32_t ms)
     }
 }
 
-/* Delay in microseconds */
+/* Busy-wait delay in microseconds */
 void delay_us(uint32_t us)
 {
     ets_delay_us(us);
@@ -0,0 +1,64 @@
+#include "semaphore.h"
+#include "kernel.h"
+#include "xtensa.h"
+
+/* Initialize a semaphore */
+void sem_init(semaphore_t *sem, const char *name, uint32_t initial, uint32_t max_count,
+              waitq_order_t order)
+{
+    sem->name = name;
+    sem->max_count = MAX(max_count, 1);
+    sem->count = MIN(initial, sem->max_count);
+    waitq_init(&sem->waiters, order);
+}
+
+/* Take a unit, waiting up to timeout_ms */
+bool sem_take(semaphore_t *sem, uint32_t timeout_ms)
+{
+    uint32_t ps = spin_lock_irqsave(&scheduler_lock);
+
+    if (sem->count > 0) {
+        sem->count--;
+        spin_unlock_irqrestore(&scheduler_lock, ps);
+        return true;
+    }
+
+    /* Only a task with interrupts enabled can block */
+    task_t *current = task_get_current_on(xt_core_id());
+    if (timeout_ms == 0 || !current || (ps & PS_INTLEVEL_MASK) != 0) {
+        spin_unlock_irqrestore(&scheduler_lock, ps);
+        return false;
+    }
+
+    /* sem_give hands its unit over without touching the count */
+    waitq_insert(&sem->waiters, current);
+    bool taken = waitq_block(&sem->waiters, timeout_ms) != 0;
+
+    spin_unlock_irqrestore(&scheduler_lock, ps);
+    return taken;
+}
+
+/* Give a unit back */
+bool sem_give(semaphore_t *sem)
+{
+    uint32_t ps = spin_lock_irqsave(&scheduler_lock);
+    task_t *waiter = waitq_peek(&sem->waiters);
+
+    if (waiter) {
+        waitq_wake(&sem->waiters, waiter, 1);
+    } else if (sem->count < sem->max_count) {
+        sem->count++;
+    } else {
+        spin_unlock_irqrestore(&scheduler_lock, ps);
+        return false;
+    }
+
+    waitq_unlock(ps);
+    return true;
+}
+
+/* Units currently available */
+uint32_t sem_count(const semaphore_t *sem)
+{
+    return sem->count;
+}
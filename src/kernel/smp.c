@@ -0,0 +1,130 @@
+#include "smp.h"
+#include "kernel.h"
+#include "interrupt.h"
+#include "esp32_defs.h"
+#include "uart.h"
+#include "log.h"
+#include "xtensa.h"
+
+/* APP CPU entry (start.S) */
+extern void _start_app_cpu(void);
+
+/* How long to wait for the APP CPU to come up */
+#define APP_CPU_TIMEOUT_US  100000
+
+/* APP CPU bring-up handshake */
+typedef enum {
+    APP_CPU_OFF = 0,
+    APP_CPU_BOOTED,         /* Running our code, waiting for the cycle count */
+    APP_CPU_SYNC,           /* app_cpu_ccount is valid */
+    APP_CPU_RUNNING         /* CCOUNT synchronized, joining the scheduler */
+} app_cpu_state_t;
+
+static volatile app_cpu_state_t app_cpu_state = APP_CPU_OFF;
+static volatile uint32_t app_cpu_ccount = 0;
+static uint32_t cores_online = 1;
+
+/* Cross-core interrupt: clear it; rescheduling happens on interrupt exit */
+static void smp_ipi_handler(void *arg)
+{
+    REG_WRITE(DPORT_CPU_INTR_FROM_CPU_REG(xt_core_id()), 0);
+}
+
+/* Set up cross-core interrupts on the PRO CPU */
+void smp_init(void)
+{
+    if (CONFIG_NUM_CORES < 2) {
+        return;
+    }
+
+    /* Each core gets its own FROM_CPU source on the same CPU interrupt */
+    REG_WRITE(DPORT_CPU_INTR_FROM_CPU_REG(0), 0);
+    REG_WRITE(DPORT_PRO_CPU_INTR_FROM_CPU_0_MAP_REG, ETS_FROM_CPU_INUM);
+    interrupt_register_handler(ETS_FROM_CPU_INUM, smp_ipi_handler, NULL);
+    interrupt_enable_source(ETS_FROM_CPU_INUM);
+}
+
+/* Interrupt another core so it reschedules or leaves idle */
+void smp_send_ipi(uint32_t core)
+{
+    if (core < CONFIG_NUM_CORES) {
+        REG_WRITE(DPORT_CPU_INTR_FROM_CPU_REG(core), 1);
+    }
+}
+
+/* Number of cores running the scheduler */
+uint32_t smp_cores_online(void)
+{
+    return cores_online;
+}
+
+/* First C code on the APP CPU (called from _start_app_cpu) */
+void app_cpu_main(void)
+{
+    /* Take over the PRO CPU's cycle count so both cores agree on the tick */
+    app_cpu_state = APP_CPU_BOOTED;
+    while (app_cpu_state != APP_CPU_SYNC);
+    xt_set_ccount(app_cpu_ccount);
+
+    REG_WRITE(DPORT_CPU_INTR_FROM_CPU_REG(1), 0);
+    REG_WRITE(DPORT_APP_CPU_INTR_FROM_CPU_1_MAP_REG, ETS_FROM_CPU_INUM);
+    interrupt_enable_source(ETS_FROM_CPU_INUM);
+
+    app_cpu_state = APP_CPU_RUNNING;
+    scheduler_start_secondary();
+}
+
+/* Wait for the APP CPU to reach a state, false on timeout */
+static bool smp_wait_app_cpu(app_cpu_state_t state)
+{
+    for (uint32_t us = 0; app_cpu_state != state; us++) {
+        if (us >= APP_CPU_TIMEOUT_US) {
+            return false;
+        }
+        ets_delay_us(1);
+    }
+    return true;
+}
+
+/* Release the APP CPU from reset and wait for it to join the scheduler */
+void smp_start_app_cpu(void)
+{
+    if (CONFIG_NUM_CORES < 2) {
+        return;
+    }
+
+    /*
+     * The APP CPU fetches flash code and data through its own cache and
+     * MMU: give it the same mapping as the PRO CPU before it runs.
+     */
+    for (uint32_t i = 0; i < DPORT_FLASH_MMU_ENTRIES; i++) {
+        REG_WRITE(DPORT_APP_FLASH_MMU_TABLE + i * 4, REG_READ(DPORT_PRO_FLASH_MMU_TABLE + i * 4));
+    }
+    REG_WRITE(DPORT_APP_CACHE_CTRL1_REG, REG_READ(DPORT_PRO_CACHE_CTRL1_REG));
+    REG_SET_BIT(DPORT_APP_CACHE_CTRL_REG, DPORT_CACHE_ENABLE);
+
+    /* The ROM starts the APP CPU at this address once it leaves reset */
+    ets_set_appcpu_boot_addr((uint32_t)_start_app_cpu);
+    REG_SET_BIT(DPORT_APPCPU_CTRL_B_REG, DPORT_APPCPU_CLKGATE_EN);
+    REG_CLEAR_BIT(DPORT_APPCPU_CTRL_C_REG, DPORT_APPCPU_RUNSTALL);
+    REG_SET_BIT(DPORT_APPCPU_CTRL_A_REG, DPORT_APPCPU_RESETTING);
+    REG_CLEAR_BIT(DPORT_APPCPU_CTRL_A_REG, DPORT_APPCPU_RESETTING);
+
+    if (!smp_wait_app_cpu(APP_CPU_BOOTED)) {
+        uart_puts("[SMP] ERROR: APP CPU did not start, running on one core\n");
+        REG_WRITE(DPORT_APPCPU_CTRL_B_REG, 0);
+        return;
+    }
+
+    /* The APP CPU's CCOUNT ends up behind by the few cycles the handoff takes */
+    app_cpu_ccount = xt_get_ccount();
+    app_cpu_state = APP_CPU_SYNC;
+
+    if (!smp_wait_app_cpu(APP_CPU_RUNNING)) {
+        uart_puts("[SMP] ERROR: APP CPU stopped during startup\n");
+        return;
+    }
+
+    cores_online = 2;
+    uart_puts("[SMP] APP CPU started\n");
+}
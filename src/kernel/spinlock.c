@@ -0,0 +1,76 @@
+#include "spinlock.h"
+#include "uart.h"
+#include "kprintf.h"
+
+/* Initialize a lock at runtime */
+void spin_lock_init(spinlock_t *lock)
+{
+    lock->owner = 0;
+#if CONFIG_LOCK_STATS
+    lock->hold_start = 0;
+    lock->stats.acquired = 0;
+    lock->stats.contended = 0;
+    lock->stats.spins = 0;
+    lock->stats.hold_max = 0;
+    lock->stats.hold_total = 0;
+#endif
+}
+
+/*
+ * Wait for a lock another core holds. Polls with plain loads and only
+ * retries S32C1I once the lock looks free, so the waiting core doesn't
+ * keep the holder's cache line busy.
+ */
+void spin_lock_contended(spinlock_t *lock, uint32_t self)
+{
+    uint32_t spins = 0;
+
+    /*
+     * It would never be released. Report without taking any lock (the
+     * held one may be the log's or the UART's) and halt.
+     */
+    if (lock->owner == self) {
+        char line[64];
+
+        ksnprintf(line, sizeof(line), "\n[LOCK] ERROR: Core %u took a spinlock it already holds\n",
+                  self - 1);
+        uart_puts_polled(line);
+        while(1);
+    }
+
+    do {
+        while (lock->owner != 0) {
+            spins++;
+        }
+    } while (xt_compare_set(&lock->owner, 0, self) != 0);
+
+#if CONFIG_LOCK_STATS
+    lock->stats.contended++;
+    lock->stats.spins += spins;
+#endif
+}
+
+/* Copy a lock's statistics */
+void spin_lock_stats(const spinlock_t *lock, spinlock_stats_t *stats)
+{
+#if CONFIG_LOCK_STATS
+    *stats = lock->stats;
+#else
+    stats->acquired = 0;
+    stats->contended = 0;
+    stats->spins = 0;
+    stats->hold_max = 0;
+    stats->hold_total = 0;
+#endif
+}
+
+/* Print a lock's statistics */
+void spin_lock_dump_stats(const char *name, const spinlock_t *lock)
+{
+    spinlock_stats_t stats;
+
+    spin_lock_stats(lock, &stats);
+    uart_printf("[LOCK] %s: %u taken, %u contended (%u polls), hold max %u avg %u cycles\n",
+                name, stats.acquired, stats.contended, stats.spins, stats.hold_max,
+                stats.acquired ? (uint32_t)(stats.hold_total / stats.acquired) : 0);
+}
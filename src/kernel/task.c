@@ -1,14 +1,53 @@
 #include "task.h"
 #include "heap.h"
+#include "pool.h"
+#include "kernel.h"
+#include "smp.h"
+#include "mutex.h"
+#include "fpu.h"
+#include "trace.h"
 #include "uart.h"
+#include "kprintf.h"
+#include "log.h"
+#include "xtensa.h"
 
-/* Current running task */
-static task_t *current_task = NULL;
+/* First code run by a new task (context.S) */
+extern void _task_start(void);
 
-/* Task list */
-static task_t *task_list[MAX_TASKS];
-static uint32_t task_count = 0;
-static uint32_t next_task_id = 0;
+/* Task running on each core */
+static task_t *current_task[CONFIG_NUM_CORES];
+
+/*
+ * Every task, sorted by ID so the lowest free ID is the first gap.
+ * Changed under scheduler_lock; task_for_each walks it without the lock,
+ * so links are published with release stores and nothing is unlinked
+ * while a walk is in progress.
+ */
+static task_t *task_all = NULL;
+static uint32_t task_walkers = 0;
+
+/* Exited tasks waiting for task_reap(), linked through next (scheduler_lock) */
+static task_t *volatile task_zombies = NULL;
+
+/*
+ * Per-core run queue: one ready list per priority and a bitmap of
+ * non-empty lists. Tasks free to run on any core are also counted per
+ * priority so another core can find work to steal without walking lists.
+ * All run queues are guarded by scheduler_lock.
+ */
+typedef struct {
+    task_t *head[TASK_PRIORITY_LEVELS];
+    task_t *tail[TASK_PRIORITY_LEVELS];
+    uint32_t bitmap;                            /* Priorities with a ready task */
+    uint32_t movable_bitmap;                    /* Priorities with a task free to migrate */
+    uint8_t movable[TASK_PRIORITY_LEVELS];      /* Tasks free to migrate, per priority */
+} run_queue_t;
+
+static run_queue_t run_queue[CONFIG_NUM_CORES];
+
+/* Object pools for TCBs and default-sized stacks */
+static pool_t *tcb_pool = NULL;
+static pool_t *stack_pool = NULL;
 
 /* String copy function */
 static void strncpy_safe(char *dst, const char *src, size_t n)
@@ -23,133 +62,656 @@ static void strncpy_safe(char *dst, const char *src, size_t n)
 /* Initialize Xtensa register context on stack */
 static void task_init_stack(task_t *task)
 {
-    uint32_t *stack_top = (uint32_t *)(task->stack_base + task->stack_size);
-
-    /* Reserve space for context (Xtensa windowed ABI) */
-    /* We need space for: A0-A15, PC, PS, SAR */
-    stack_top -= 19;  /* 19 registers */
-
-    /* Initialize stack frame */
-    stack_top[0] = 0;                        /* A0 (return address) */
-    stack_top[1] = (uint32_t)task->arg;      /* A2 (first argument) */
-    stack_top[2] = 0;                        /* A3 */
-    stack_top[3] = 0;                        /* A4 */
-    stack_top[4] = 0;                        /* A5 */
-    stack_top[5] = 0;                        /* A6 */
-    stack_top[6] = 0;                        /* A7 */
-    stack_top[7] = 0;                        /* A8 */
-    stack_top[8] = 0;                        /* A9 */
-    stack_top[9] = 0;                        /* A10 */
-    stack_top[10] = 0;                       /* A11 */
-    stack_top[11] = 0;                       /* A12 */
-    stack_top[12] = 0;                       /* A13 */
-    stack_top[13] = 0;                       /* A14 */
-    stack_top[14] = 0;                       /* A15 */
-    stack_top[15] = (uint32_t)task->entry;   /* PC (entry point) */
-    stack_top[16] = 0x00040020;              /* PS (user mode, interrupts enabled) */
-    stack_top[17] = 0;                       /* SAR */
-    stack_top[18] = (uint32_t)task_exit;     /* A1 (exit function if task returns) */
+    /* Xtensa stack pointers are 16-byte aligned */
+    uint32_t stack_top = ALIGN_DOWN(task->stack_base + task->stack_size, 16);
+    uint32_t *frame = (uint32_t *)(stack_top - XT_STK_FRMSZ);
+
+    /* Mark every word so the high-water mark and overflows can be seen */
+    if (CONFIG_STACK_CHECK) {
+        for (uint32_t *word = (uint32_t *)task->stack_base; word < frame; word++) {
+            *word = TASK_STACK_FILL;
+        }
+    }
+
+    for (uint32_t i = 0; i < XT_STK_FRMSZ / 4; i++) {
+        frame[i] = 0;
+    }
+
+    /* Resume into _task_start, which calls entry(arg) and then task_exit */
+    frame[XT_STK_PC / 4] = (uint32_t)_task_start;
+    frame[XT_STK_PS / 4] = PS_UM | PS_WOE | PS_EXCM;    /* Interrupts enabled */
+    frame[XT_STK_A1 / 4] = stack_top;
+    frame[XT_STK_A2 / 4] = (uint32_t)task->entry;
+    frame[XT_STK_A3 / 4] = (uint32_t)task->arg;
 
     /* Set the task's stack pointer */
-    task->stack_ptr = stack_top;
+    task->stack_ptr = frame;
 }
 
-/* Initialize task system */
-void task_init(void)
+/* Count leading zeros with the Xtensa NSAU instruction (32 for zero) */
+static inline uint32_t task_nsau(uint32_t value)
 {
-    task_count = 0;
-    next_task_id = 0;
-    current_task = NULL;
+    uint32_t result;
+    __asm__ ("nsau %0, %1" : "=a" (result) : "a" (value));
+    return result;
+}
 
-    for (uint32_t i = 0; i < MAX_TASKS; i++) {
-        task_list[i] = NULL;
+/* Highest priority set in a bitmap, or -1 if none */
+static inline int task_top_priority(uint32_t bitmap)
+{
+    return 31 - (int)task_nsau(bitmap);
+}
+
+/* Unlink a task from its core's ready queue */
+static void task_ready_remove(task_t *task)
+{
+    run_queue_t *rq = &run_queue[task->core];
+    uint32_t prio = task->priority;
+
+    if (task->prev) {
+        task->prev->next = task->next;
+    } else {
+        rq->head[prio] = task->next;
+    }
+    if (task->next) {
+        task->next->prev = task->prev;
+    } else {
+        rq->tail[prio] = task->prev;
     }
+    task->next = NULL;
+    task->prev = NULL;
 
-    uart_puts("[TASK] Task system initialized\n");
+    if (!rq->head[prio]) {
+        rq->bitmap &= ~BIT(prio);
+    }
+    if (task->affinity == TASK_AFFINITY_ANY && --rq->movable[prio] == 0) {
+        rq->movable_bitmap &= ~BIT(prio);
+    }
 }
 
-/* Create a new task */
-task_t *task_create(const char *name, task_entry_t entry, void *arg, uint32_t stack_size)
+/* Interrupt other cores that should run a newly ready task before what they have */
+static void task_kick(task_t *task)
 {
-    if (task_count >= MAX_TASKS) {
-        uart_puts("[TASK] ERROR: Maximum tasks reached\n");
-        return NULL;
+    uint32_t self = xt_core_id();
+
+    for (uint32_t core = 0; core < CONFIG_NUM_CORES; core++) {
+        task_t *running = current_task[core];
+
+        if (core == self || !running) {
+            continue;
+        }
+        if (task->affinity != TASK_AFFINITY_ANY && task->affinity != (int32_t)core) {
+            continue;
+        }
+        if (task->priority > running->priority) {
+            smp_send_ipi(core);
+        }
     }
+}
+
+/* Allocate a stack, preferring the stack pool for the default size */
+static uint32_t *task_alloc_stack(uint32_t stack_size)
+{
+    uint32_t *stack = NULL;
+
+    if (stack_pool && stack_size == TASK_STACK_SIZE) {
+        stack = (uint32_t *)pool_alloc(stack_pool);
+    }
+    if (!stack) {
+        stack = (uint32_t *)kmalloc(stack_size);
+    }
+
+    return stack;
+}
+
+/* Return a stack to the pool or heap it came from */
+static void task_free_stack(uint32_t *stack)
+{
+    if (stack_pool && pool_contains(stack_pool, stack)) {
+        pool_free(stack_pool, stack);
+    } else {
+        kfree(stack);
+    }
+}
+
+/* Allocate a TCB, from the pool while it lasts */
+static task_t *task_alloc_tcb(void)
+{
+    task_t *task = tcb_pool ? (task_t *)pool_alloc(tcb_pool) : NULL;
 
-    /* Allocate TCB */
-    task_t *task = (task_t *)kmalloc(sizeof(task_t));
     if (!task) {
-        uart_puts("[TASK] ERROR: Failed to allocate TCB\n");
-        return NULL;
+        task = (task_t *)kmalloc(sizeof(task_t));
     }
+    return task;
+}
 
-    /* Allocate stack */
-    uint32_t *stack = (uint32_t *)kmalloc(stack_size);
-    if (!stack) {
-        uart_puts("[TASK] ERROR: Failed to allocate stack\n");
+/* Return a TCB to the pool or heap it came from */
+static void task_free_tcb(task_t *task)
+{
+    if (tcb_pool && pool_contains(tcb_pool, task)) {
+        pool_free(tcb_pool, task);
+    } else {
         kfree(task);
-        return NULL;
     }
+}
 
-    /* Initialize TCB */
+/*
+ * Give a task the lowest unused ID and link it into the all-task list
+ * in ID order (scheduler_lock held)
+ */
+static void task_list_insert(task_t *task)
+{
+    task_t *prev = NULL;
+    task_t *cur = task_all;
+    uint32_t id = 0;
+
+    while (cur && cur->id == id) {
+        prev = cur;
+        cur = cur->all_next;
+        id++;
+    }
+
+    task->id = id;
+    task->all_prev = prev;
+    task->all_next = cur;
+    if (cur) {
+        cur->all_prev = task;
+    }
+
+    /* A concurrent task_for_each sees the task only once it is complete */
+    __atomic_store_n(prev ? &prev->all_next : &task_all, task, __ATOMIC_RELEASE);
+}
+
+/* Unlink a task from the all-task list (scheduler_lock held, no walkers) */
+static void task_list_remove(task_t *task)
+{
+    if (task->all_prev) {
+        task->all_prev->all_next = task->all_next;
+    } else {
+        task_all = task->all_next;
+    }
+    if (task->all_next) {
+        task->all_next->all_prev = task->all_prev;
+    }
+}
+
+/* Initialize task system */
+void task_init(void)
+{
+    task_all = NULL;
+    task_walkers = 0;
+    task_zombies = NULL;
+
+    for (uint32_t core = 0; core < CONFIG_NUM_CORES; core++) {
+        run_queue_t *rq = &run_queue[core];
+
+        current_task[core] = NULL;
+        for (uint32_t i = 0; i < TASK_PRIORITY_LEVELS; i++) {
+            rq->head[i] = NULL;
+            rq->tail[i] = NULL;
+            rq->movable[i] = 0;
+        }
+        rq->bitmap = 0;
+        rq->movable_bitmap = 0;
+    }
+
+    /* Boot tasks are static in a zero-heap build; later ones use the heap directly */
+    if (!CONFIG_STATIC_TASKS) {
+        tcb_pool = pool_create("tcb", sizeof(task_t), TASK_TCB_POOL);
+        stack_pool = pool_create("stack", TASK_STACK_SIZE, TASK_STACK_POOL);
+    }
+
+    uart_puts("[TASK] Task system initialized\n");
+}
+
+/* Initialize a TCB over its stack and make the task ready */
+static void task_setup(task_t *task, const char *name, task_entry_t entry, void *arg,
+                       uint32_t *stack, uint32_t stack_size, uint32_t priority,
+                       int32_t affinity)
+{
     task->entry = entry;
     task->arg = arg;
     task->state = TASK_STATE_READY;
     task->stack_base = (uint32_t)stack;
     task->stack_size = stack_size;
-    task->id = next_task_id++;
+    task->priority = MIN(priority, TASK_PRIORITY_MAX);
+    task->base_priority = task->priority;
+    task->core = xt_core_id();
+    task->affinity = affinity;
+    task->wake_pending = false;
+    task->timed_out = false;
+    task->time_slice = CONFIG_TIME_SLICE_TICKS;
+    task->slice_left = CONFIG_TIME_SLICE_TICKS;
+    task->wake_tick = 0;
+    task->sleep_next = NULL;
+    task->sleep_prev = NULL;
+    task->wait_next = NULL;
+    task->wait_value = 0;
+    task->wait_bits = 0;
+    task->wait_flags = 0;
+    task->notify_value = 0;
+    task->notify_state = TASK_NOTIFY_NONE;
+    for (uint32_t i = 0; i < TASK_FPU_STATE_WORDS; i++) {
+        task->fpu_state[i] = 0;
+    }
+    task->run_start = 0;
+    task->ready_since = 0;
+    task->stats.run_cycles = 0;
+    task->stats.voluntary = 0;
+    task->stats.involuntary = 0;
+    task->blocked_on = NULL;
+    task->held_mutexes = NULL;
+    task->next = NULL;
+    task->prev = NULL;
     strncpy_safe(task->name, name, sizeof(task->name));
 
     /* Initialize stack with context */
     task_init_stack(task);
 
-    /* Add to task list */
-    task_list[task_count++] = task;
+    /* Add to task list (which assigns the ID) and ready queue */
+    uint32_t ps = spin_lock_irqsave(&scheduler_lock);
+    task_list_insert(task);
+    task_make_ready(task);
+    spin_unlock_irqrestore(&scheduler_lock, ps);
+
+    TRACE(TRACE_TASK_CREATE, task->id);
+
+    LOG_INFO("[TASK] Created task '%s' (ID: %d, priority: %d, stack: %x)\n",
+             task->name, task->id, task->priority, task->stack_base);
+}
+
+/* Create a new task */
+task_t *task_create(const char *name, task_entry_t entry, void *arg,
+                    uint32_t stack_size, uint32_t priority)
+{
+    return task_create_pinned(name, entry, arg, stack_size, priority, TASK_AFFINITY_ANY);
+}
+
+/* Create a new task that only ever runs on one core */
+task_t *task_create_pinned(const char *name, task_entry_t entry, void *arg,
+                           uint32_t stack_size, uint32_t priority, int32_t core)
+{
+    if (core >= CONFIG_NUM_CORES) {
+        LOG_ERROR("[TASK] ERROR: Invalid core %d\n", core);
+        return NULL;
+    }
+    if (core < 0) {
+        core = TASK_AFFINITY_ANY;
+    }
+
+    /* Recycle exited tasks first so create/exit cycles don't grow the heap */
+    task_reap();
+
+    /* Allocate TCB */
+    task_t *task = task_alloc_tcb();
+    if (!task) {
+        LOG_ERROR("[TASK] ERROR: Failed to allocate TCB\n");
+        return NULL;
+    }
+
+    /* Allocate stack */
+    uint32_t *stack = task_alloc_stack(stack_size);
+    if (!stack) {
+        LOG_ERROR("[TASK] ERROR: Failed to allocate stack\n");
+        task_free_tcb(task);
+        return NULL;
+    }
+
+    task->static_alloc = false;
+    task_setup(task, name, entry, arg, stack, stack_size, priority, core);
+    return task;
+}
 
-    uart_printf("[TASK] Created task '%s' (ID: %d, stack: %x)\n",
-                task->name, task->id, task->stack_base);
+/* Create a task in caller-provided TCB and stack memory */
+task_t *task_create_static(task_t *task, const char *name, task_entry_t entry, void *arg,
+                           void *stack, uint32_t stack_size, uint32_t priority)
+{
+    if (!task || !stack || ((uintptr_t)stack & (TASK_STACK_ALIGN - 1))) {
+        LOG_ERROR("[TASK] ERROR: Invalid static TCB or stack\n");
+        return NULL;
+    }
+    if (stack_size < XT_STK_FRMSZ + 16) {
+        LOG_ERROR("[TASK] ERROR: Stack too small (%d bytes)\n", stack_size);
+        return NULL;
+    }
 
+    task->static_alloc = true;
+    task_setup(task, name, entry, arg, (uint32_t *)stack, stack_size, priority,
+               TASK_AFFINITY_ANY);
     return task;
 }
 
-/* Get current running task */
+/* Get the task running on this core */
 task_t *task_get_current(void)
 {
-    return current_task;
+    /* Masked so the task can't migrate between reading the core ID and the slot */
+    uint32_t ps = xt_irq_save();
+    task_t *task = current_task[xt_core_id()];
+    xt_irq_restore(ps);
+
+    return task;
+}
+
+/* Get the task running on a given core */
+task_t *task_get_current_on(uint32_t core)
+{
+    return (core < CONFIG_NUM_CORES) ? current_task[core] : NULL;
 }
 
-/* Set current running task */
+/* Set the task running on this core (interrupts masked) */
 void task_set_current(task_t *task)
 {
-    current_task = task;
+    current_task[xt_core_id()] = task;
 }
 
 /* Terminate current task */
 void task_exit(void)
 {
-    if (current_task) {
-        uart_printf("[TASK] Task '%s' exiting\n", current_task->name);
-        current_task->state = TASK_STATE_TERMINATED;
-        task_yield();  /* Switch to another task */
+    task_t *current = task_get_current();
+
+    if (current) {
+        LOG_INFO("[TASK] Task '%s' exiting\n", current->name);
+        if (current->held_mutexes) {
+            LOG_WARN("[TASK] WARNING: Task '%s' exiting with mutexes held\n", current->name);
+        }
+
+        /* Hand them to their waiters: once reaped, an owner pointer would dangle */
+        while (current->held_mutexes) {
+            mutex_unlock(current->held_mutexes);
+        }
+        TRACE(TRACE_TASK_EXIT, current->id);
+
+        /* Switched out for good; the scheduler queues it for task_reap() */
+        uint32_t ps = spin_lock_irqsave(&scheduler_lock);
+        current->state = TASK_STATE_TERMINATED;
+        spin_unlock_irqrestore(&scheduler_lock, ps);
+        task_yield();
     }
 
     /* Should never reach here */
     while(1);
 }
 
-/* Get next ready task (round-robin) */
+/* Bytes of a task's stack it has ever used */
+uint32_t task_stack_used(task_t *task)
+{
+    if (!CONFIG_STACK_CHECK) {
+        return task->stack_size;
+    }
+
+    /* The stack grows down: count untouched words up from the base */
+    const uint32_t *word = (const uint32_t *)task->stack_base;
+    const uint32_t *end = (const uint32_t *)(task->stack_base + task->stack_size);
+    while (word < end && *word == TASK_STACK_FILL) {
+        word++;
+    }
+    return (uint32_t)end - (uint32_t)word;
+}
+
+/* Print one task's stack high-water mark */
+static void task_dump_stack(task_t *task, void *arg)
+{
+    uint32_t used = task_stack_used(task);
+
+    uart_printf("[TASK] %-15s stack %u of %u bytes used (%u%%)\n",
+                task->name, used, task->stack_size, used * 100 / task->stack_size);
+}
+
+/* Print every task's stack high-water mark */
+void task_dump_stacks(void)
+{
+    task_for_each(task_dump_stack, NULL);
+}
+
+/*
+ * Report a stack overflow and halt. Called with scheduler_lock held, which
+ * is never released, so the other core stops at its next scheduling point.
+ */
+void task_stack_overflow(task_t *task)
+{
+    char line[64];
+
+    xt_irq_save();
+    ksnprintf(line, sizeof(line), "[TASK] ERROR: Stack overflow in task '%s'\n", task->name);
+    uart_puts_polled(line);
+    while(1);
+}
+
+/* Call fn for every task in ID order */
+void task_for_each(task_visit_t fn, void *arg)
+{
+    uint32_t ps = spin_lock_irqsave(&scheduler_lock);
+    task_walkers++;
+    task_t *task = task_all;
+    spin_unlock_irqrestore(&scheduler_lock, ps);
+
+    while (task) {
+        fn(task, arg);
+        task = __atomic_load_n(&task->all_next, __ATOMIC_ACQUIRE);
+    }
+
+    ps = spin_lock_irqsave(&scheduler_lock);
+    task_walkers--;
+    spin_unlock_irqrestore(&scheduler_lock, ps);
+}
+
+/*
+ * Queue an exited task for reaping. Called from the scheduler as the
+ * task is switched out; scheduler_lock is only released once the core
+ * has left the task's stack, so a reaper that finds it here can free it.
+ */
+void task_retire_locked(task_t *task)
+{
+    task->next = task_zombies;
+    task_zombies = task;
+}
+
+/* Free the TCBs and stacks of exited tasks */
+void task_reap(void)
+{
+    /* Cheap check first: the idle tasks call this on every pass */
+    if (!task_zombies) {
+        return;
+    }
+
+    uint32_t ps = spin_lock_irqsave(&scheduler_lock);
+    if (task_walkers) {
+        spin_unlock_irqrestore(&scheduler_lock, ps);
+        return;
+    }
+    task_t *task = task_zombies;
+    task_zombies = NULL;
+    for (task_t *t = task; t; t = t->next) {
+        task_list_remove(t);
+    }
+    spin_unlock_irqrestore(&scheduler_lock, ps);
+
+    /* The heap lock may not be taken inside scheduler_lock */
+    while (task) {
+        task_t *next = task->next;
+        if (!task->static_alloc) {
+            task_free_stack((uint32_t *)task->stack_base);
+            task_free_tcb(task);
+        }
+        task = next;
+    }
+}
+
+/* Copy a task's CPU accounting */
+void task_get_stats(task_t *task, task_stats_t *stats)
+{
+    uint32_t ps = spin_lock_irqsave(&scheduler_lock);
+    *stats = task->stats;
+    if (task->state == TASK_STATE_RUNNING) {
+        /* The cores' CCOUNTs are synchronized, so this works across cores */
+        stats->run_cycles += xt_get_ccount() - task->run_start;
+    }
+    spin_unlock_irqrestore(&scheduler_lock, ps);
+}
+
+/* Print one task's share of a core (arg: cycles elapsed) and its switch counts */
+static void task_dump_task_stats(task_t *task, void *arg)
+{
+    uint64_t elapsed = *(const uint64_t *)arg;
+    task_stats_t stats;
+
+    task_get_stats(task, &stats);
+    uint32_t permille = elapsed ? (uint32_t)(stats.run_cycles * 1000 / elapsed) : 0;
+    uart_printf("[TASK] %-15s %3u.%u%% CPU, %u voluntary, %u preempted\n",
+                task->name, permille / 10, permille % 10,
+                stats.voluntary, stats.involuntary);
+}
+
+/* Print every task's share of one core and its switch counts */
+void task_dump_stats(void)
+{
+    uint64_t elapsed = 0;
+
+    scheduler_idle_stats(0, NULL, &elapsed, NULL);
+    task_for_each(task_dump_task_stats, &elapsed);
+}
+
+/* Change a task's base priority */
+void task_set_priority(task_t *task, uint32_t priority)
+{
+    uint32_t ps = spin_lock_irqsave(&scheduler_lock);
+    task->base_priority = MIN(priority, TASK_PRIORITY_MAX);
+    mutex_update_priority(task);
+    spin_unlock_irqrestore(&scheduler_lock, ps);
+}
+
+/* Change the priority a task runs at now, requeueing it if ready */
+void task_set_priority_locked(task_t *task, uint32_t priority)
+{
+    if (task->state == TASK_STATE_READY) {
+        task_ready_remove(task);
+        task->priority = priority;
+        task_make_ready(task);
+    } else {
+        task->priority = priority;
+    }
+}
+
+/*
+ * Pin a task to one core, or let it run anywhere. A running task moves
+ * the next time it is switched out. Returns false if the core is invalid
+ * or another core's FPU holds the task's registers.
+ */
+bool task_set_affinity(task_t *task, int32_t core)
+{
+    if (core >= CONFIG_NUM_CORES) {
+        LOG_ERROR("[TASK] ERROR: Invalid core %d\n", core);
+        return false;
+    }
+    if (core < 0) {
+        core = TASK_AFFINITY_ANY;
+    }
+
+    uint32_t ps = spin_lock_irqsave(&scheduler_lock);
+    if (!fpu_prepare_move(task, core)) {
+        spin_unlock_irqrestore(&scheduler_lock, ps);
+        return false;
+    }
+    if (task->state == TASK_STATE_READY) {
+        task_ready_remove(task);
+        task->affinity = core;
+        task_make_ready(task);
+    } else {
+        task->affinity = core;
+    }
+    spin_unlock_irqrestore(&scheduler_lock, ps);
+    return true;
+}
+
+/* Change a task's time slice */
+void task_set_time_slice(task_t *task, uint32_t ticks)
+{
+    task->time_slice = ticks;
+    task->slice_left = ticks;
+}
+
+/*
+ * Put a task at the tail of its priority's ready queue on the core it
+ * last ran on (or is pinned to). Call with scheduler_lock held.
+ */
+void task_make_ready(task_t *task)
+{
+    if (task->affinity != TASK_AFFINITY_ANY) {
+        task->core = task->affinity;
+    }
+
+    run_queue_t *rq = &run_queue[task->core];
+    uint32_t prio = task->priority;
+
+    task->state = TASK_STATE_READY;
+    task->next = NULL;
+    task->prev = rq->tail[prio];
+    if (rq->tail[prio]) {
+        rq->tail[prio]->next = task;
+    } else {
+        rq->head[prio] = task;
+    }
+    rq->tail[prio] = task;
+    rq->bitmap |= BIT(prio);
+    if (task->affinity == TASK_AFFINITY_ANY) {
+        rq->movable[prio]++;
+        rq->movable_bitmap |= BIT(prio);
+    }
+
+    task_kick(task);
+}
+
+/*
+ * Highest priority this core could run next: its own queue, or a task
+ * it could steal from another core. -1 if none. Call with scheduler_lock
+ * held.
+ */
+int task_ready_priority(void)
+{
+    uint32_t self = xt_core_id();
+    int prio = task_top_priority(run_queue[self].bitmap);
+
+    for (uint32_t core = 0; core < CONFIG_NUM_CORES; core++) {
+        if (core != self) {
+            prio = MAX(prio, task_top_priority(run_queue[core].movable_bitmap));
+        }
+    }
+
+    return prio;
+}
+
+/*
+ * Remove and return the highest-priority task this core can run. A task
+ * free to migrate is stolen from another core when it outranks
+ * everything queued here; ties stay local. Call with scheduler_lock held.
+ */
 task_t *task_get_next_ready(void)
 {
-    static uint32_t last_index = 0;
-    uint32_t start_index = last_index;
+    uint32_t self = xt_core_id();
+    run_queue_t *from = &run_queue[self];
+    int prio = task_top_priority(from->bitmap);
 
-    do {
-        last_index = (last_index + 1) % task_count;
-        if (task_list[last_index] &&
-            task_list[last_index]->state == TASK_STATE_READY) {
-            return task_list[last_index];
+    for (uint32_t core = 0; core < CONFIG_NUM_CORES; core++) {
+        int other = task_top_priority(run_queue[core].movable_bitmap);
+        if (core != self && other > prio) {
+            from = &run_queue[core];
+            prio = other;
         }
-    } while (last_index != start_index);
+    }
 
-    return NULL;  /* No ready tasks */
+    if (prio < 0) {
+        return NULL;  /* No ready tasks */
+    }
+
+    task_t *task = from->head[prio];
+    if (from != &run_queue[self]) {
+        /* Skip tasks pinned to their core */
+        while (task->affinity != TASK_AFFINITY_ANY) {
+            task = task->next;
+        }
+    }
+
+    task_ready_remove(task);
+    task->core = self;
+    return task;
 }
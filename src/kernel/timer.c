@@ -0,0 +1,302 @@
+#include "timer.h"
+#include "kernel.h"
+#include "spinlock.h"
+#include "uart.h"
+#include "xtensa.h"
+
+/*
+ * Timing wheel.
+ *
+ * wheel_time is the next tick to process. A timer due in fewer than
+ * 32^(k+1) ticks from wheel_time sits at level k, in the slot given by
+ * bits 5k..5k+4 of its expiry tick. Level-0 slots are run as
+ * wheel_time reaches them; each time wheel_time enters a new 32-tick
+ * block, the level-1 slot for that block is cascaded down (re-filed
+ * relative to wheel_time), and so on up the levels. A bitmap per level
+ * lets the wheel skip empty slots and find its next event with NSAU.
+ */
+
+#define TIMER_WHEEL_MASK    (TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_RANGE   (1U << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS))
+
+/* Guards the wheel and every active timer's links */
+static spinlock_t timer_lock = SPINLOCK_INIT;
+
+static timer_t *timer_wheel[TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS];
+static uint32_t timer_bitmap[TIMER_WHEEL_LEVELS];   /* Occupied slots per level */
+static uint32_t wheel_time = 0;
+
+static task_t *timer_task = NULL;
+static bool timer_task_sleeping = false;            /* Blocked until timer_wake_tick */
+static bool timer_wake_armed = false;               /* Whether timer_wake_tick is set */
+static uint32_t timer_wake_tick = 0;
+
+/* Put a timer in the slot for its expiry tick (timer_lock held) */
+static void timer_insert(timer_t *timer)
+{
+    int32_t delta = (int32_t)(timer->expires - wheel_time);
+    uint32_t expires = timer->expires;
+    uint32_t level = 0;
+
+    if (delta < 0) {
+        /* Overdue: the slot being processed */
+        expires = wheel_time;
+    } else {
+        /* Beyond the wheel: file it in the last slot and re-file it from there */
+        if ((uint32_t)delta >= TIMER_WHEEL_RANGE) {
+            delta = TIMER_WHEEL_RANGE - 1;
+            expires = wheel_time + delta;
+        }
+        level = (31 - __builtin_clz((uint32_t)delta | 1)) / TIMER_WHEEL_BITS;
+    }
+
+    uint32_t index = (expires >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK;
+    uint32_t slot = level * TIMER_WHEEL_SLOTS + index;
+
+    timer->slot = slot;
+    timer->next = timer_wheel[slot];
+    timer->pprev = &timer_wheel[slot];
+    if (timer->next) {
+        timer->next->pprev = &timer->next;
+    }
+    timer_wheel[slot] = timer;
+    timer_bitmap[level] |= BIT(index);
+}
+
+/* Take a timer out of the wheel (timer_lock held) */
+static void timer_unlink(timer_t *timer)
+{
+    *timer->pprev = timer->next;
+    if (timer->next) {
+        timer->next->pprev = timer->pprev;
+    }
+    if (!timer_wheel[timer->slot]) {
+        timer_bitmap[timer->slot / TIMER_WHEEL_SLOTS] &= ~BIT(timer->slot % TIMER_WHEEL_SLOTS);
+    }
+    timer->next = NULL;
+    timer->pprev = NULL;
+}
+
+/* wheel_time entered a new level-0 block: re-file the higher slots now due */
+static void timer_cascade(void)
+{
+    for (uint32_t level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+        uint32_t index = (wheel_time >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK;
+        uint32_t slot = level * TIMER_WHEEL_SLOTS + index;
+        timer_t *timer = timer_wheel[slot];
+
+        timer_wheel[slot] = NULL;
+        timer_bitmap[level] &= ~BIT(index);
+        while (timer) {
+            timer_t *next = timer->next;
+            timer_insert(timer);
+            timer = next;
+        }
+
+        /* The next level only turns over when this one wraps */
+        if (index) {
+            break;
+        }
+    }
+}
+
+/* Advance the wheel up to now and take one due timer off it (timer_lock held) */
+static timer_t *timer_pop_due(uint32_t now)
+{
+    while ((int32_t)(now - wheel_time) >= 0) {
+        uint32_t index = wheel_time & TIMER_WHEEL_MASK;
+        timer_t *timer = timer_wheel[index];
+
+        if (timer) {
+            timer_unlink(timer);
+            return timer;
+        }
+
+        /* Skip to the next occupied level-0 slot in this block, or its end */
+        uint32_t later = timer_bitmap[0] & ~((2U << index) - 1);
+        uint32_t step = later ? (uint32_t)__builtin_ctz(later) - index : TIMER_WHEEL_SLOTS - index;
+
+        if ((int32_t)(wheel_time + step - now) > 1) {
+            wheel_time = now + 1;
+            break;
+        }
+        wheel_time += step;
+        if (!(wheel_time & TIMER_WHEEL_MASK)) {
+            timer_cascade();
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Find the wheel's next event (timer_lock held): the next occupied
+ * level-0 slot, or the start of the block whose higher slot must be
+ * cascaded. Returns false if the wheel is empty.
+ */
+static bool timer_next_event(uint32_t *tick)
+{
+    bool found = false;
+
+    for (uint32_t level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        uint32_t bitmap = timer_bitmap[level];
+        if (!bitmap) {
+            continue;
+        }
+
+        /* Distance from the current slot to the next occupied one, wrapping */
+        uint32_t shift = TIMER_WHEEL_BITS * level;
+        uint32_t block = wheel_time >> shift;
+        uint32_t from = (block + (level ? 1 : 0)) & TIMER_WHEEL_MASK;
+        uint32_t rotated = from ? (bitmap >> from) | (bitmap << (TIMER_WHEEL_SLOTS - from)) : bitmap;
+        uint32_t distance = __builtin_ctz(rotated) + (level ? 1 : 0);
+        uint32_t event = level ? (block + distance) << shift : wheel_time + distance;
+
+        if (!found || (int32_t)(event - *tick) < 0) {
+            *tick = event;
+            found = true;
+        }
+    }
+
+    return found;
+}
+
+/* Initialize a stopped timer that runs fn(arg) */
+void timer_init(timer_t *timer, timer_fn_t fn, void *arg)
+{
+    timer->next = NULL;
+    timer->pprev = NULL;
+    timer->expires = 0;
+    timer->period = 0;
+    timer->fn = fn;
+    timer->arg = arg;
+    timer->slot = 0;
+}
+
+/* (Re)start a timer to fire after delay_ms, then every period_ms */
+void timer_start(timer_t *timer, uint32_t delay_ms, uint32_t period_ms)
+{
+    uint32_t ps = spin_lock_irqsave(&timer_lock);
+
+    if (timer->pprev) {
+        timer_unlink(timer);
+    }
+
+    /*
+     * A sleeping timer task leaves wheel_time behind, without limit
+     * once the wheel is empty. If nothing is due yet, skip it to now so
+     * the new deadline is measured from the present.
+     */
+    uint32_t now = scheduler_get_ticks();
+    uint32_t next;
+    if (!timer_next_event(&next)) {
+        wheel_time = now;
+    } else if ((int32_t)(now - wheel_time) > 0 && (int32_t)(next - now) > 0) {
+        wheel_time = now;
+    }
+
+    /* One extra tick: the current tick period is already partly over */
+    timer->expires = now + ms_to_ticks(delay_ms) + 1;
+    timer->period = period_ms ? MAX(ms_to_ticks(period_ms), 1) : 0;
+    timer_insert(timer);
+
+    /* Wake the timer task if it sleeps past the new deadline */
+    bool wake = timer_task_sleeping &&
+                (!timer_wake_armed || (int32_t)(timer->expires - timer_wake_tick) < 0);
+    if (wake) {
+        timer_task_sleeping = false;
+    }
+    spin_unlock_irqrestore(&timer_lock, ps);
+
+    if (wake) {
+        task_wake(timer_task);
+    }
+}
+
+/* Stop a timer, returns false if it wasn't active */
+bool timer_stop(timer_t *timer)
+{
+    uint32_t ps = spin_lock_irqsave(&timer_lock);
+    bool active = timer->pprev != NULL;
+
+    if (active) {
+        timer_unlink(timer);
+    }
+    spin_unlock_irqrestore(&timer_lock, ps);
+
+    return active;
+}
+
+/* Run every timer due by now, periodic ones re-filed first */
+static void timer_run(uint32_t now)
+{
+    while (1) {
+        uint32_t ps = spin_lock_irqsave(&timer_lock);
+        timer_t *timer = timer_pop_due(now);
+
+        if (!timer) {
+            spin_unlock_irqrestore(&timer_lock, ps);
+            return;
+        }
+
+        timer_fn_t fn = timer->fn;
+        void *arg = timer->arg;
+        if (timer->period) {
+            /* Keep the period without drift, but skip runs already missed */
+            timer->expires += timer->period;
+            if ((int32_t)(timer->expires - now) <= 0) {
+                timer->expires = now + timer->period;
+            }
+            timer_insert(timer);
+        }
+        spin_unlock_irqrestore(&timer_lock, ps);
+
+        fn(arg);
+    }
+}
+
+/* Timer task: run due timers, then sleep until the wheel's next event */
+static void timer_task_entry(void *arg)
+{
+    (void)arg;
+
+    while (1) {
+        timer_run(scheduler_get_ticks());
+
+        /* Masked until blocked, so a timer_start() wakeup can't be lost */
+        uint32_t ps = xt_irq_save();
+        spin_lock(&timer_lock);
+        timer_wake_armed = timer_next_event(&timer_wake_tick);
+        timer_task_sleeping = true;
+        bool armed = timer_wake_armed;
+        uint32_t wake_tick = timer_wake_tick;
+        spin_unlock(&timer_lock);
+
+        if (armed) {
+            task_block_until(wake_tick);
+        } else {
+            task_block();
+        }
+
+        spin_lock(&timer_lock);
+        timer_task_sleeping = false;
+        spin_unlock(&timer_lock);
+        xt_irq_restore(ps);
+    }
+}
+
+/* Start the timer task */
+void timer_service_init(void)
+{
+    wheel_time = scheduler_get_ticks();
+
+    timer_task = TASK_CREATE_BOOT("timer", timer_task_entry, NULL, TASK_STACK_SIZE,
+                                  TIMER_TASK_PRIORITY);
+    if (!timer_task) {
+        uart_puts("[TIMER] ERROR: Failed to create timer task\n");
+        return;
+    }
+
+    uart_printf("[TIMER] Timer service started (%d Hz, %d-level wheel)\n",
+                CONFIG_TICK_HZ, TIMER_WHEEL_LEVELS);
+}
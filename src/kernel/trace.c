@@ -0,0 +1,96 @@
+#include "trace.h"
+#include "task.h"
+#include "uart.h"
+#include "esp32_defs.h"
+#include "xtensa.h"
+
+#if CONFIG_TRACE
+
+#define TRACE_BUFFER_MASK   (TRACE_BUFFER_EVENTS - 1)
+
+/* Events printed per dump line */
+#define TRACE_LINE_EVENTS   4
+
+typedef struct {
+    uint32_t timestamp;             /* CCOUNT */
+    uint32_t info;                  /* Event, core and argument */
+} trace_event_t;
+
+/* One ring per core, written only by that core */
+typedef struct {
+    trace_event_t events[TRACE_BUFFER_EVENTS];
+    uint32_t head;                  /* Events recorded so far */
+} trace_ring_t;
+
+static trace_ring_t trace_ring[CONFIG_NUM_CORES];
+static volatile bool trace_running = true;
+
+/* Record one event on this core */
+void trace_record(uint32_t event, uint32_t arg)
+{
+    if (!trace_running) {
+        return;
+    }
+
+    uint32_t ps = xt_irq_save();
+    uint32_t core = xt_core_id();
+    trace_ring_t *ring = &trace_ring[core];
+    trace_event_t *ev = &ring->events[ring->head++ & TRACE_BUFFER_MASK];
+
+    ev->timestamp = xt_get_ccount();
+    ev->info = (event << TRACE_EVENT_S) | (core << TRACE_CORE_S) | (arg & TRACE_ARG_MASK);
+    xt_irq_restore(ps);
+}
+
+/* Start recording */
+void trace_start(void)
+{
+    trace_running = true;
+}
+
+/* Stop recording */
+void trace_stop(void)
+{
+    trace_running = false;
+}
+
+/* Print one task's ID and name */
+static void trace_dump_task(task_t *task, void *arg)
+{
+    uart_printf("[TRACE] TASK %u %s\n", task->id, task->name);
+}
+
+/*
+ * Print everything recorded. Recording stops first so the dump's own
+ * UART interrupts don't overwrite the rings while they are printed.
+ */
+void trace_dump(void)
+{
+    trace_stop();
+
+    uart_printf("[TRACE] BEGIN %u\n", CPU_CLK_FREQ);
+
+    task_for_each(trace_dump_task, NULL);
+
+    for (uint32_t core = 0; core < CONFIG_NUM_CORES; core++) {
+        trace_ring_t *ring = &trace_ring[core];
+        uint32_t count = MIN(ring->head, TRACE_BUFFER_EVENTS);
+        uint32_t first = ring->head - count;
+
+        for (uint32_t i = 0; i < count; i += TRACE_LINE_EVENTS) {
+            uart_puts("[TRACE] EV");
+            for (uint32_t j = i; j < MIN(i + TRACE_LINE_EVENTS, count); j++) {
+                const trace_event_t *ev = &ring->events[(first + j) & TRACE_BUFFER_MASK];
+                uart_printf(" %08x%08x", ev->timestamp, ev->info);
+            }
+            uart_puts("\n");
+        }
+        ring->head = 0;
+    }
+
+    uart_puts("[TRACE] END\n");
+
+    trace_start();
+}
+
+#endif /* CONFIG_TRACE */
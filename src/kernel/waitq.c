@@ -0,0 +1,101 @@
+#include "waitq.h"
+#include "kernel.h"
+#include "xtensa.h"
+
+/* Initialize an empty queue */
+void waitq_init(waitq_t *wq, waitq_order_t order)
+{
+    wq->head = NULL;
+    wq->order = order;
+}
+
+/* Add a task in the queue's order */
+void waitq_insert(waitq_t *wq, task_t *task)
+{
+    task_t **link = &wq->head;
+
+    if (wq->order == WAITQ_PRIORITY) {
+        while (*link && (*link)->priority >= task->priority) {
+            link = &(*link)->wait_next;
+        }
+    } else {
+        while (*link) {
+            link = &(*link)->wait_next;
+        }
+    }
+
+    task->wait_value = 0;
+    task->wait_next = *link;
+    *link = task;
+}
+
+/* Block the current task until waitq_wake() or timeout */
+uint32_t waitq_block(waitq_t *wq, uint32_t timeout_ms)
+{
+    task_t *current = task_get_current_on(xt_core_id());
+    uint32_t deadline = scheduler_get_ticks() + ms_to_ticks(timeout_ms) + 1;
+
+    for (;;) {
+        bool woken = true;
+        if (timeout_ms == TASK_WAIT_FOREVER) {
+            task_block_locked();
+        } else {
+            woken = task_block_until_locked(deadline);
+        }
+        spin_lock(&scheduler_lock);
+
+        if (current->wait_value) {
+            return current->wait_value;
+        }
+
+        /* Other wakeups are stale; keep waiting until the deadline */
+        if (!woken) {
+            waitq_remove(wq, current);
+            return 0;
+        }
+    }
+}
+
+/* Take a task off the queue and wake it */
+void waitq_wake(waitq_t *wq, task_t *task, uint32_t value)
+{
+    waitq_remove(wq, task);
+    task->wait_value = value;
+    task_wake_locked(task);
+}
+
+/* Release scheduler_lock after waking waiters */
+void waitq_unlock(uint32_t ps)
+{
+    if ((ps & PS_INTLEVEL_MASK) == 0) {
+        scheduler_reschedule_locked();
+    } else {
+        spin_unlock(&scheduler_lock);
+    }
+    xt_irq_restore(ps);
+}
+
+/* Remove a task, returns false if it wasn't queued */
+bool waitq_remove(waitq_t *wq, task_t *task)
+{
+    for (task_t **link = &wq->head; *link; link = &(*link)->wait_next) {
+        if (*link == task) {
+            *link = task->wait_next;
+            task->wait_next = NULL;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Remove and return the next task to release */
+task_t *waitq_pop(waitq_t *wq)
+{
+    task_t *task = wq->head;
+
+    if (task) {
+        wq->head = task->wait_next;
+        task->wait_next = NULL;
+    }
+    return task;
+}
@@ -0,0 +1,142 @@
+#include "workqueue.h"
+#include "uart.h"
+#include "xtensa.h"
+
+/*
+ * Items are pushed on a singly linked LIFO list; the worker swaps the
+ * whole list out for NULL and reverses it to run items oldest first.
+ * Producers only ever push and the worker only ever takes everything,
+ * so there is no ABA problem and neither side takes a lock.
+ */
+
+static volatile uint32_t work_list = 0;  /* Newest submitted item (work_t *), or 0 */
+static task_t *work_task = NULL;
+static work_stats_t work_statistics;
+
+/* Initialize a work item that runs fn(arg) */
+void work_init(work_t *work, work_fn_t fn, void *arg)
+{
+    work->next = NULL;
+    work->fn = fn;
+    work->arg = arg;
+    work->pending = 0;
+    work->submitted = 0;
+}
+
+/* Queue a work item, returns false if it is already queued */
+bool work_submit(work_t *work)
+{
+    if (xt_compare_set(&work->pending, 0, 1) != 0) {
+        return false;
+    }
+
+    work->submitted = xt_get_ccount();
+
+    uint32_t head;
+    do {
+        head = work_list;
+        work->next = (work_t *)head;
+    } while (xt_compare_set(&work_list, head, (uint32_t)work) != head);
+
+    /* Only the first item of a batch needs to wake the worker */
+    if (!head && work_task) {
+        task_notify_give(work_task);
+    }
+    return true;
+}
+
+/* Take every submitted item, oldest first */
+static work_t *work_take_all(uint32_t *count)
+{
+    uint32_t head;
+    do {
+        head = work_list;
+    } while (head && xt_compare_set(&work_list, head, 0) != head);
+
+    work_t *list = NULL;
+    work_t *work = (work_t *)head;
+    *count = 0;
+    while (work) {
+        work_t *next = work->next;
+        work->next = list;
+        list = work;
+        work = next;
+        (*count)++;
+    }
+    return list;
+}
+
+/* Work task: drain the list each time the first item of a batch arrives */
+static void work_task_entry(void *arg)
+{
+    (void)arg;
+
+    while (1) {
+        task_notify_take(true, TASK_WAIT_FOREVER);
+
+        /* Items submitted while draining join this batch (and leave a spare wakeup) */
+        uint32_t batch = 0;
+        uint32_t depth;
+        work_t *work;
+        while ((work = work_take_all(&depth)) != NULL) {
+            work_statistics.depth_max = MAX(work_statistics.depth_max, depth);
+
+            while (work) {
+                work_t *next = work->next;
+                work_fn_t fn = work->fn;
+                void *fn_arg = work->arg;
+                uint32_t submitted = work->submitted;
+
+                /* From here the item may be submitted again, even by fn itself */
+                __atomic_store_n(&work->pending, 0, __ATOMIC_RELEASE);
+                fn(fn_arg);
+
+                uint32_t latency = xt_get_ccount() - submitted;
+                work_statistics.latency_total += latency;
+                work_statistics.latency_max = MAX(work_statistics.latency_max, latency);
+                work_statistics.completed++;
+                batch++;
+                work = next;
+            }
+        }
+
+        if (batch) {
+            work_statistics.wakeups++;
+            work_statistics.batch_max = MAX(work_statistics.batch_max, batch);
+        }
+    }
+}
+
+/* Start the work task */
+void workqueue_init(void)
+{
+    work_task = TASK_CREATE_BOOT("work", work_task_entry, NULL, TASK_STACK_SIZE,
+                                 WORK_TASK_PRIORITY);
+    if (!work_task) {
+        uart_puts("[WORK] ERROR: Failed to create work task\n");
+        return;
+    }
+
+    /* Pick up anything submitted before the task existed */
+    if (work_list) {
+        task_notify_give(work_task);
+    }
+}
+
+/* Copy the worker statistics */
+void work_stats(work_stats_t *stats)
+{
+    *stats = work_statistics;
+}
+
+/* Print the worker statistics */
+void work_dump_stats(void)
+{
+    work_stats_t stats;
+
+    work_stats(&stats);
+    uart_printf("[WORK] %u items in %u wakeups (batch max %u, depth max %u), latency max %u avg %u cycles\n",
+                stats.completed, stats.wakeups, stats.batch_max, stats.depth_max,
+                stats.latency_max,
+                stats.completed ? (uint32_t)(stats.latency_total / stats.completed) : 0);
+}
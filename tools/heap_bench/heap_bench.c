@@ -0,0 +1,204 @@
+/*
+ * Host benchmark: kernel TLSF heap vs. the original first-fit allocator.
+ *
+ * Both allocators run the same pseudo-random alloc/free workload over a
+ * heap of the same size as the target's .dram0.heap region. Per-operation
+ * latency is reported as min/avg/max, and fragmentation as the share of
+ * free memory that cannot be returned by a single allocation, averaged
+ * over periodic samples. Live blocks carry a fill pattern that is checked
+ * before every free to catch overlapping allocations.
+ *
+ * Build and run with: make heap-bench
+ */
+#define _POSIX_C_SOURCE 199309L
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Kernel heap (src/kernel/heap.c) */
+void heap_init_region(void *start, unsigned int size);
+void *kmalloc(unsigned int size);
+void kfree(void *ptr);
+void heap_stats(uint32_t *total, uint32_t *used, uint32_t *free);
+
+/* Original first-fit allocator (heap_firstfit.c) */
+void ff_init_region(void *start, unsigned int size);
+void *ff_malloc(unsigned int size);
+void ff_free(void *ptr);
+void ff_stats(uint32_t *total, uint32_t *used, uint32_t *free);
+
+/* Symbols the kernel heap expects from the firmware image */
+uint32_t _heap_start;
+uint32_t _heap_end;
+
+void uart_printf(const char *fmt, ...) { (void)fmt; }
+void uart_puts(const char *str) { (void)str; }
+void log_write(uint32_t level, uint32_t fmt_id, const uint32_t *args,
+               uint32_t nargs, uint32_t str_mask) { }
+
+#define BENCH_HEAP_SIZE     (32 * 1024)
+#define BENCH_SLOTS         96
+#define BENCH_OPS           200000
+#define BENCH_MIN_ALLOC     8
+#define BENCH_MAX_ALLOC     768
+#define BENCH_SAMPLE_EVERY  5000
+
+typedef struct {
+    const char *name;
+    void (*init)(void *start, unsigned int size);
+    void *(*alloc)(unsigned int size);
+    void (*free)(void *ptr);
+    void (*stats)(uint32_t *total, uint32_t *used, uint32_t *free);
+} allocator_t;
+
+typedef struct {
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t min_ns;
+    uint64_t max_ns;
+} latency_t;
+
+static uint64_t heap_area[BENCH_HEAP_SIZE / sizeof(uint64_t)];
+static uint32_t rng_state;
+
+static uint32_t rng_next(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void latency_add(latency_t *lat, uint64_t ns)
+{
+    if (lat->count == 0 || ns < lat->min_ns) lat->min_ns = ns;
+    if (ns > lat->max_ns) lat->max_ns = ns;
+    lat->total_ns += ns;
+    lat->count++;
+}
+
+static void latency_print(const char *what, const latency_t *lat)
+{
+    printf("  %-6s min %5llu ns  avg %7.1f ns  max %7llu ns  (%llu ops)\n", what,
+           (unsigned long long)lat->min_ns,
+           lat->count ? (double)lat->total_ns / lat->count : 0.0,
+           (unsigned long long)lat->max_ns,
+           (unsigned long long)lat->count);
+}
+
+/* Largest single allocation that currently succeeds */
+static uint32_t largest_alloc(const allocator_t *a)
+{
+    uint32_t lo = 0, hi = BENCH_HEAP_SIZE;
+
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo + 1) / 2;
+        void *p = a->alloc(mid);
+        if (p) {
+            a->free(p);
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return lo;
+}
+
+static void run(const allocator_t *a, uint32_t seed)
+{
+    void *slots[BENCH_SLOTS] = { 0 };
+    uint32_t sizes[BENCH_SLOTS] = { 0 };
+    latency_t alloc_lat = { 0 }, free_lat = { 0 };
+    uint32_t failures = 0, corruptions = 0;
+    double frag_sum = 0.0;
+    uint32_t frag_samples = 0;
+
+    rng_state = seed;
+    a->init(heap_area, sizeof(heap_area));
+
+    for (uint32_t op = 0; op < BENCH_OPS; op++) {
+        uint32_t slot = rng_next() % BENCH_SLOTS;
+        uint64_t t0, t1;
+
+        if (slots[slot]) {
+            /* Every byte must still hold the owner's fill pattern */
+            for (uint32_t i = 0; i < sizes[slot]; i++) {
+                if (((uint8_t *)slots[slot])[i] != (uint8_t)slot) {
+                    corruptions++;
+                    break;
+                }
+            }
+            t0 = now_ns();
+            a->free(slots[slot]);
+            t1 = now_ns();
+            latency_add(&free_lat, t1 - t0);
+            slots[slot] = NULL;
+        } else {
+            uint32_t size = BENCH_MIN_ALLOC + rng_next() % (BENCH_MAX_ALLOC - BENCH_MIN_ALLOC);
+            t0 = now_ns();
+            slots[slot] = a->alloc(size);
+            t1 = now_ns();
+            latency_add(&alloc_lat, t1 - t0);
+            if (slots[slot]) {
+                memset(slots[slot], slot, size);
+                sizes[slot] = size;
+            } else {
+                failures++;
+            }
+        }
+
+        if ((op + 1) % BENCH_SAMPLE_EVERY == 0) {
+            uint32_t free;
+            a->stats(NULL, NULL, &free);
+            if (free) {
+                frag_sum += 1.0 - (double)largest_alloc(a) / free;
+                frag_samples++;
+            }
+        }
+    }
+
+    uint32_t total, used, free;
+    a->stats(&total, &used, &free);
+    uint32_t largest = largest_alloc(a);
+
+    printf("%s\n", a->name);
+    latency_print("alloc", &alloc_lat);
+    latency_print("free", &free_lat);
+    printf("  failed allocations: %u, corrupted blocks: %u\n", failures, corruptions);
+    printf("  heap at end: %u total, %u used, %u free, largest allocation %u\n",
+           total, used, free, largest);
+    printf("  fragmentation: %.1f%% average over %u samples\n\n",
+           frag_samples ? 100.0 * frag_sum / frag_samples : 0.0, frag_samples);
+
+    for (uint32_t i = 0; i < BENCH_SLOTS; i++) {
+        a->free(slots[i]);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    static const allocator_t allocators[] = {
+        { "first-fit (original)", ff_init_region, ff_malloc, ff_free, ff_stats },
+        { "tlsf (kmalloc)", heap_init_region, kmalloc, kfree, heap_stats },
+    };
+    uint32_t seed = argc > 1 ? (uint32_t)strtoul(argv[1], NULL, 0) : 0x2545F491u;
+
+    printf("heap %u bytes, %u live slots, %u ops, sizes %u..%u, seed 0x%08x\n\n",
+           BENCH_HEAP_SIZE, BENCH_SLOTS, BENCH_OPS, BENCH_MIN_ALLOC, BENCH_MAX_ALLOC, seed);
+
+    for (size_t i = 0; i < sizeof(allocators) / sizeof(allocators[0]); i++) {
+        run(&allocators[i], seed);
+    }
+
+    return 0;
+}
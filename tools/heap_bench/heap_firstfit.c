@@ -0,0 +1,95 @@
+/*
+ * Reference copy of the original first-fit allocator, renamed so it can be
+ * linked next to the kernel heap in the host benchmark.
+ */
+#include "types.h"
+
+typedef struct ff_block {
+    size_t size;                    /* Size of this block (excluding header) */
+    bool is_free;                   /* Is this block free? */
+    struct ff_block *next;          /* Next block in list */
+} ff_block_t;
+
+#define FF_BLOCK_HEADER_SIZE sizeof(ff_block_t)
+#define FF_ALIGN_SIZE sizeof(void *)
+
+static ff_block_t *ff_head = NULL;
+static uint32_t ff_size = 0;
+static uint32_t ff_used = 0;
+
+static size_t ff_align_size(size_t size)
+{
+    return (size + FF_ALIGN_SIZE - 1) & ~(FF_ALIGN_SIZE - 1);
+}
+
+void ff_init_region(void *start, size_t size)
+{
+    ff_head = (ff_block_t *)start;
+    ff_size = size;
+    ff_used = FF_BLOCK_HEADER_SIZE;
+
+    ff_head->size = ff_size - FF_BLOCK_HEADER_SIZE;
+    ff_head->is_free = true;
+    ff_head->next = NULL;
+}
+
+void *ff_malloc(size_t size)
+{
+    if (size == 0) {
+        return NULL;
+    }
+
+    size = ff_align_size(size);
+
+    for (ff_block_t *current = ff_head; current != NULL; current = current->next) {
+        if (current->is_free && current->size >= size) {
+            if (current->size >= size + FF_BLOCK_HEADER_SIZE + FF_ALIGN_SIZE) {
+                ff_block_t *new_block = (ff_block_t *)((uint8_t *)current + FF_BLOCK_HEADER_SIZE + size);
+                new_block->size = current->size - size - FF_BLOCK_HEADER_SIZE;
+                new_block->is_free = true;
+                new_block->next = current->next;
+
+                current->size = size;
+                current->next = new_block;
+            }
+
+            current->is_free = false;
+            ff_used += current->size + FF_BLOCK_HEADER_SIZE;
+            return (uint8_t *)current + FF_BLOCK_HEADER_SIZE;
+        }
+    }
+
+    return NULL;
+}
+
+void ff_free(void *ptr)
+{
+    if (ptr == NULL) {
+        return;
+    }
+
+    ff_block_t *block = (ff_block_t *)((uint8_t *)ptr - FF_BLOCK_HEADER_SIZE);
+    if (block->is_free) {
+        return;
+    }
+
+    block->is_free = true;
+    ff_used -= block->size + FF_BLOCK_HEADER_SIZE;
+
+    ff_block_t *current = ff_head;
+    while (current != NULL && current->next != NULL) {
+        if (current->is_free && current->next->is_free) {
+            current->size += current->next->size + FF_BLOCK_HEADER_SIZE;
+            current->next = current->next->next;
+        } else {
+            current = current->next;
+        }
+    }
+}
+
+void ff_stats(uint32_t *total, uint32_t *used, uint32_t *free)
+{
+    if (total) *total = ff_size;
+    if (used) *used = ff_used;
+    if (free) *free = ff_size - ff_used;
+}
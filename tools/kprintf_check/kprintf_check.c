@@ -0,0 +1,103 @@
+/*
+ * Host check: kernel ksnprintf() against expected output.
+ *
+ * Each case formats one value and compares the result and the returned
+ * length with what C99 printf produces. Truncation into a short buffer
+ * is checked separately. Exits nonzero if any case fails.
+ *
+ * Build and run with: make kprintf-check
+ */
+#include <stdio.h>
+#include <string.h>
+
+/* Kernel formatting core (src/kernel/kprintf.c, size_t is 32-bit there) */
+int ksnprintf(char *buf, unsigned int size, const char *fmt, ...);
+
+static int failures;
+static int checks;
+
+static void check(const char *fmt, const char *expect, const char *got, int len)
+{
+    checks++;
+    if (strcmp(got, expect) != 0 || len != (int)strlen(expect)) {
+        printf("FAIL \"%s\": got \"%s\" (%d), expected \"%s\" (%d)\n",
+               fmt, got, len, expect, (int)strlen(expect));
+        failures++;
+    }
+}
+
+#define CHECK(expect, fmt, ...) do {                                    \
+    char buf_[64];                                                      \
+    int len_ = ksnprintf(buf_, sizeof(buf_), fmt, __VA_ARGS__);         \
+    check(fmt, expect, buf_, len_);                                     \
+} while (0)
+
+int main(void)
+{
+    /* Signed decimal */
+    CHECK("0", "%d", 0);
+    CHECK("-42", "%d", -42);
+    CHECK("-2147483648", "%d", (int)0x80000000);
+    CHECK("+7", "%+d", 7);
+    CHECK(" 7", "% d", 7);
+    CHECK("   -5", "%5d", -5);
+    CHECK("-0005", "%05d", -5);
+    CHECK("-5   |", "%-5d|", -5);
+    CHECK("  007", "%5.3d", 7);
+    CHECK("", "%.0d", 0);
+    CHECK("    ", "%4.0d", 0);
+    CHECK("-9223372036854775808", "%lld", (long long)0x8000000000000000ULL);
+    CHECK("-1", "%hhd", 255);
+    CHECK("-32768", "%hd", 32768);
+
+    /* Unsigned and hex */
+    CHECK("4294967295", "%u", 0xFFFFFFFFU);
+    CHECK("18446744073709551615", "%llu", ~0ULL);
+    CHECK("deadbeef", "%x", 0xDEADBEEFU);
+    CHECK("DEADBEEF", "%X", 0xDEADBEEFU);
+    CHECK("0x1f", "%#x", 0x1FU);
+    CHECK("0X1F", "%#X", 0x1FU);
+    CHECK("0", "%#x", 0U);
+    CHECK("0x0001f", "%#.5x", 0x1FU);
+    CHECK("0x00001f", "%#08x", 0x1FU);
+    CHECK("", "%#.0x", 0U);
+    CHECK("ff", "%hhx", 0x1FFU);
+
+    /* Octal, '#' always leaves exactly one leading zero */
+    CHECK("17", "%o", 15U);
+    CHECK("017", "%#o", 15U);
+    CHECK("0", "%o", 0U);
+    CHECK("0", "%#o", 0U);
+    CHECK("", "%.0o", 0U);
+    CHECK("0", "%#.0o", 0U);
+    CHECK("    0", "%#5.0o", 0U);
+    CHECK("  010", "%#5.3o", 8U);
+    CHECK("010", "%#.2o", 8U);
+    CHECK("00010", "%#05o", 8U);
+    CHECK("1777777777777777777777", "%llo", ~0ULL);
+
+    /* Characters, strings and '*' */
+    CHECK("a", "%c", 'a');
+    CHECK("  a", "%3c", 'a');
+    CHECK("hello", "%s", "hello");
+    CHECK("hel", "%.3s", "hello");
+    CHECK("   hi|", "%5s|", "hi");
+    CHECK("hi   |", "%-5s|", "hi");
+    CHECK("(null)", "%s", (char *)NULL);
+    CHECK("   42", "%*d", 5, 42);
+    CHECK("42   |", "%*d|", -5, 42);
+    CHECK("00042", "%.*d", 5, 42);
+    CHECK("100%", "%d%%", 100);
+
+    /* Truncation: NUL-terminated, full length returned */
+    char small[6];
+    int len = ksnprintf(small, sizeof(small), "%s-%d", "abcdef", 12);
+    checks++;
+    if (strcmp(small, "abcde") != 0 || len != 9) {
+        printf("FAIL truncation: got \"%s\" (%d), expected \"abcde\" (9)\n", small, len);
+        failures++;
+    }
+
+    printf("kprintf: %d/%d checks passed\n", checks - failures, checks);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,214 @@
+#!/usr/bin/env python3
+"""
+Decode the kernel's deferred log stream (include/log.h).
+
+Reads the UART stream from a serial port, a capture file or stdin.
+Plain text is passed through unchanged; binary log frames are expanded
+using the format strings in the ELF's .log_fmt section.
+
+    log_decode.py build/esp32-kernel.elf --port /dev/ttyUSB0
+    log_decode.py build/esp32-kernel.elf capture.bin
+"""
+
+import argparse
+import re
+import struct
+import sys
+
+# Must match include/log.h
+LOG_HDR_VALID = 1 << 31
+LOG_HDR_PAD = 1 << 30
+LOG_HDR_LEVEL_S, LOG_HDR_LEVEL = 24, 0x7
+LOG_HDR_NARGS_S, LOG_HDR_NARGS = 20, 0xF
+LOG_HDR_STRMASK_S, LOG_HDR_STRMASK = 12, 0xFF
+LOG_FMT_DROPPED = 0xFFFFFFFF
+LOG_FRAME_SYNC = 0xFF
+LOG_FRAME_TAG = ord('L')
+
+CPU_CLK_FREQ = 160000000
+
+SPEC_RE = re.compile(r'%([-+ #0]*)(\d*)(?:\.(\d+))?(hh|h|ll|l|z)?([diuxXcsp%])')
+
+
+def load_formats(elf_path):
+    """Return {offset: format string} from the ELF's .log_fmt section."""
+    with open(elf_path, 'rb') as f:
+        elf = f.read()
+
+    if elf[:4] != b'\x7fELF' or elf[4] != 1 or elf[5] != 1:
+        sys.exit('%s: not a 32-bit little-endian ELF' % elf_path)
+
+    shoff, = struct.unpack_from('<I', elf, 0x20)
+    shentsize, shnum, shstrndx = struct.unpack_from('<HHH', elf, 0x2E)
+
+    def section(index):
+        name, _, _, _, offset, size = struct.unpack_from('<IIIIII', elf, shoff + index * shentsize)
+        return name, offset, size
+
+    _, strtab_off, _ = section(shstrndx)
+    for i in range(shnum):
+        name, offset, size = section(i)
+        end = elf.index(b'\0', strtab_off + name)
+        if elf[strtab_off + name:end] == b'.log_fmt':
+            data = elf[offset:offset + size]
+            break
+    else:
+        sys.exit('%s: no .log_fmt section' % elf_path)
+
+    formats = {}
+    pos = 0
+    while pos < len(data):
+        end = data.index(b'\0', pos)
+        formats[pos] = data[pos:end].decode('utf-8', 'replace')
+        pos = end + 1
+        while pos < len(data) and data[pos] == 0:
+            pos += 1
+    return formats
+
+
+def format_message(fmt, words, str_mask, strings):
+    """Expand a C format string with the record's argument words."""
+    args = iter(enumerate(words))
+    out = []
+    pos = 0
+
+    for m in SPEC_RE.finditer(fmt):
+        out.append(fmt[pos:m.start()])
+        pos = m.end()
+        flags, width, prec, length, conv = m.groups()
+        if conv == '%':
+            out.append('%')
+            continue
+
+        # Every argument is one word; log.h rejects 64-bit ones
+        try:
+            index, value = next(args)
+        except StopIteration:
+            out.append('<missing>')
+            continue
+
+        spec = '%' + flags + width + ('.' + prec if prec else '')
+        if str_mask & (1 << index):
+            out.append((spec + 's') % strings.get(index, ''))
+        elif conv in 'di':
+            if value & (1 << 31):
+                value -= 1 << 32
+            out.append((spec + 'd') % value)
+        elif conv == 'u':
+            out.append((spec + 'd') % value)
+        elif conv in 'xX':
+            out.append((spec + conv) % value)
+        elif conv == 'p':
+            out.append('0x%08x' % value)
+        elif conv == 'c':
+            out.append((spec + 'c') % chr(value & 0xFF))
+        else:
+            out.append('<0x%08x>' % value)
+
+    out.append(fmt[pos:])
+    return ''.join(out)
+
+
+def decode_record(words, formats, state):
+    header, fmt_id, timestamp = words[0], words[1], words[2]
+    nargs = (header >> LOG_HDR_NARGS_S) & LOG_HDR_NARGS
+    str_mask = (header >> LOG_HDR_STRMASK_S) & LOG_HDR_STRMASK
+    args = words[3:3 + nargs]
+
+    # Copied strings follow the arguments, each NUL-terminated and word-padded
+    blob = struct.pack('<%dI' % (len(words) - 3 - nargs), *words[3 + nargs:])
+    strings = {}
+    pos = 0
+    for i in range(nargs):
+        if str_mask & (1 << i):
+            length = args[i]
+            strings[i] = blob[pos:pos + length - 1].decode('utf-8', 'replace')
+            pos += (length + 3) & ~3
+
+    if fmt_id == LOG_FMT_DROPPED:
+        text = '[LOG] WARNING: %d messages dropped\n' % args[0]
+    elif fmt_id in formats:
+        text = format_message(formats[fmt_id], args, str_mask, strings)
+    else:
+        text = '[LOG] <unknown format 0x%08x> %s\n' % (fmt_id, ' '.join('%08x' % a for a in args))
+
+    if state.get('timestamps'):
+        last = state.get('last')
+        delta = 0 if last is None else (timestamp - last) & 0xFFFFFFFF
+        state['last'] = timestamp
+        text = '[+%10.3f ms] %s' % (delta * 1000.0 / CPU_CLK_FREQ, text)
+    return text
+
+
+class Decoder:
+    """Splits the UART stream into plain text and log frames."""
+
+    def __init__(self, formats, write, timestamps=False):
+        self.formats = formats
+        self.write = write
+        self.state = {'timestamps': timestamps}
+        self.buf = bytearray()
+
+    def feed(self, data):
+        buf = self.buf
+        buf += data
+
+        while buf:
+            sync = buf.find(bytes([LOG_FRAME_SYNC]))
+            if sync < 0:
+                self.write(buf.decode('utf-8', 'replace'))
+                buf.clear()
+                break
+            if sync > 0:
+                self.write(buf[:sync].decode('utf-8', 'replace'))
+                del buf[:sync]
+            if len(buf) < 3:
+                break
+            if buf[1] != LOG_FRAME_TAG or buf[2] < 3:
+                # Not a frame, just a stray byte
+                del buf[:1]
+                continue
+            size = 3 + 4 * buf[2]
+            if len(buf) < size:
+                break
+            words = list(struct.unpack_from('<%dI' % buf[2], buf, 3))
+            del buf[:size]
+            if words[0] & LOG_HDR_VALID and not words[0] & LOG_HDR_PAD:
+                self.write(decode_record(words, self.formats, self.state))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Decode the kernel log stream')
+    parser.add_argument('elf', help='kernel ELF with the .log_fmt section')
+    parser.add_argument('input', nargs='?', help='capture file (default: stdin)')
+    parser.add_argument('--port', help='read from a serial port instead')
+    parser.add_argument('--baud', type=int, default=115200)
+    parser.add_argument('-t', '--timestamps', action='store_true',
+                        help='prefix messages with the time since the previous one')
+    args = parser.parse_args()
+
+    def write(text):
+        sys.stdout.write(text.replace('\r\n', '\n'))
+        sys.stdout.flush()
+
+    decoder = Decoder(load_formats(args.elf), write, args.timestamps)
+
+    try:
+        if args.port:
+            import serial
+            port = serial.Serial(args.port, args.baud, timeout=0.1)
+            while True:
+                decoder.feed(port.read(4096))
+        else:
+            stream = open(args.input, 'rb') if args.input else sys.stdin.buffer
+            while True:
+                data = stream.read(4096)
+                if not data:
+                    break
+                decoder.feed(data)
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,158 @@
+#!/usr/bin/env python3
+"""
+Convert a kernel trace dump (include/trace.h) to Chrome trace JSON.
+
+Reads captured serial output containing the "[TRACE]" lines printed by
+trace_dump() and writes a trace for chrome://tracing or ui.perfetto.dev:
+one track per core with task run slices and nested interrupt slices,
+task creation and exit markers, and a heap usage counter. The last dump
+in the capture is used.
+
+    trace_export.py capture.txt -o trace.json
+"""
+
+import argparse
+import json
+import sys
+
+# Must match include/trace.h
+TRACE_TASK_SWITCH_IN = 1
+TRACE_TASK_SWITCH_OUT = 2
+TRACE_TASK_CREATE = 3
+TRACE_TASK_EXIT = 4
+TRACE_ISR_ENTER = 5
+TRACE_ISR_EXIT = 6
+TRACE_HEAP_ALLOC = 7
+TRACE_HEAP_FREE = 8
+TRACE_EVENT_S = 28
+TRACE_CORE_S = 27
+TRACE_ARG_MASK = 0x07FFFFFF
+
+PREFIX = '[TRACE] '
+
+
+def parse_dump(lines):
+    """Return (cpu frequency, {task id: name}, [(core, [(ccount, info)])]) of the last dump."""
+    dump = None
+    for line in lines:
+        pos = line.find(PREFIX)
+        if pos < 0:
+            continue
+        fields = line[pos + len(PREFIX):].split(None, 2)
+        if not fields:
+            continue
+        if fields[0] == 'BEGIN':
+            dump = {'freq': int(fields[1]), 'tasks': {}, 'events': []}
+        elif dump is None:
+            continue
+        elif fields[0] == 'TASK':
+            dump['tasks'][int(fields[1])] = fields[2].strip() if len(fields) > 2 else '?'
+        elif fields[0] == 'EV':
+            for word in line[pos + len(PREFIX) + 2:].split():
+                dump['events'].append((int(word[:8], 16), int(word[8:16], 16)))
+        elif fields[0] == 'END':
+            break
+
+    if dump is None:
+        sys.exit('no trace dump found')
+
+    # The dump lists each core's ring oldest first, one core after the other
+    cores = {}
+    for ccount, info in dump['events']:
+        cores.setdefault((info >> TRACE_CORE_S) & 1, []).append((ccount, info))
+    return dump['freq'], dump['tasks'], cores
+
+
+def unwrap(cores):
+    """Turn 32-bit CCOUNTs into cycles relative to the newest event across all cores."""
+    # Compare the ring tails modulo 2^32: the raw maximum is wrong when
+    # one core's newest CCOUNT has wrapped and another's has not
+    newest = None
+    for ring in cores.values():
+        if ring and (newest is None or
+                     0 < (ring[-1][0] - newest) & 0xFFFFFFFF < 0x80000000):
+            newest = ring[-1][0]
+    events = []
+    for ring in cores.values():
+        if not ring:
+            continue
+        # Walk back from each core's newest event; gaps are under a CCOUNT wrap
+        t = -((newest - ring[-1][0]) & 0xFFFFFFFF)
+        prev = ring[-1][0]
+        timed = []
+        for ccount, info in reversed(ring):
+            t -= (prev - ccount) & 0xFFFFFFFF
+            prev = ccount
+            timed.append((t, info))
+        events.extend(reversed(timed))
+    events.sort(key=lambda e: e[0])
+    return events
+
+
+def convert(freq, tasks, events):
+    """Build the Chrome trace event list."""
+    start = events[0][0] if events else 0
+    us = lambda t: (t - start) * 1e6 / freq
+    out = []
+    stacks = {}
+    heap = 0
+
+    def task_name(task_id):
+        return '%s (%d)' % (tasks.get(task_id, 'task'), task_id)
+
+    for t, info in events:
+        event = info >> TRACE_EVENT_S
+        core = (info >> TRACE_CORE_S) & 1
+        arg = info & TRACE_ARG_MASK
+        stack = stacks.setdefault(core, [])
+        base = {'pid': 0, 'tid': core, 'ts': us(t)}
+
+        if event in (TRACE_TASK_SWITCH_IN, TRACE_ISR_ENTER):
+            name = task_name(arg) if event == TRACE_TASK_SWITCH_IN else 'IRQ %d' % arg
+            stack.append(name)
+            out.append(dict(base, ph='B', name=name,
+                            cat='task' if event == TRACE_TASK_SWITCH_IN else 'irq'))
+        elif event in (TRACE_TASK_SWITCH_OUT, TRACE_ISR_EXIT):
+            # The ring may start in the middle of a slice: drop unmatched ends
+            if stack:
+                stack.pop()
+                out.append(dict(base, ph='E'))
+        elif event in (TRACE_TASK_CREATE, TRACE_TASK_EXIT):
+            what = 'create' if event == TRACE_TASK_CREATE else 'exit'
+            out.append(dict(base, ph='i', s='t', cat='task', name='%s %s' % (what, task_name(arg))))
+        elif event in (TRACE_HEAP_ALLOC, TRACE_HEAP_FREE):
+            heap += arg if event == TRACE_HEAP_ALLOC else -arg
+            out.append(dict(base, ph='C', tid=0, name='heap', args={'bytes since start': heap}))
+
+    # Close whatever was still running at the end of the dump
+    end = us(events[-1][0]) if events else 0
+    for core, stack in stacks.items():
+        for _ in stack:
+            out.append({'pid': 0, 'tid': core, 'ts': end, 'ph': 'E'})
+
+    out.append({'pid': 0, 'ph': 'M', 'name': 'process_name', 'args': {'name': 'ESP32 kernel'}})
+    for core in sorted(stacks):
+        out.append({'pid': 0, 'tid': core, 'ph': 'M', 'name': 'thread_name',
+                    'args': {'name': 'Core %d' % core}})
+    return out
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Convert a kernel trace dump to Chrome trace JSON')
+    parser.add_argument('input', nargs='?', help='captured serial output (default: stdin)')
+    parser.add_argument('-o', '--output', help='JSON file to write (default: stdout)')
+    args = parser.parse_args()
+
+    stream = open(args.input, errors='replace') if args.input else sys.stdin
+    freq, tasks, cores = parse_dump(stream)
+    trace = {'traceEvents': convert(freq, tasks, unwrap(cores)), 'displayTimeUnit': 'ns'}
+
+    if args.output:
+        with open(args.output, 'w') as f:
+            json.dump(trace, f)
+    else:
+        json.dump(trace, sys.stdout)
+
+
+if __name__ == '__main__':
+    main()